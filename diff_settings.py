@@ -7,6 +7,12 @@ def add_custom_arguments(parser):
         dest='version',
         help="Decide what version of the game to use (us, etc.)",
     )
+    parser.add_argument(
+        "--overlay",
+        default=None,
+        dest='overlay',
+        help="Diff a chunk of a CDDATA/DAT archive instead of rock_neo, as ARCHIVE/chunk (e.g. ST1A/ovl0__progbin_r3_st1a.bin)",
+    )
 
 
 def apply_rock_neo(config, version):
@@ -19,19 +25,23 @@ def apply_rock_neo(config, version):
 
 
 def apply_bin(config, version, name):
+    # the retail chunk is extracted by tools/nativediff.py so both images share the same layout
+    archive, chunk = name.split('/', 1)
     config["arch"] = "mipsel"
-    config['baseimg'] = f'disks/{version}/' + (f'CDDATA/DAT/{name}.BIN').upper()
-    config['myimg'] = f'build/{version}/' + (f'{name}.bin').upper()
-    config['mapfile'] = f'build/{version}/{name}.map'
+    config['baseimg'] = f'build/{archive}.{chunk}.good.bin'
+    config['myimg'] = f'build/{archive}.{chunk}.elf.bin'
+    config['mapfile'] = f'build/{archive}.{chunk}.map'
     config['source_directories'] = [
-        f'src/{name}', 'include', f'asm/{version}/{name}']
+        f'src/{archive}/{chunk}', 'include', f'asm/{archive}/{chunk}']
     config['objdump_executable'] = 'mipsel-elf-objdump'
 
 
 def apply(config, args):
-    name = 'rock_neo'
     version = args.version or 'us'
-    if name.startswith("rock_neo"):
+    overlay = getattr(args, 'overlay', None)
+    if overlay:
+        apply_bin(config, version, overlay)
+    else:
         apply_rock_neo(config, version)
 
     config["arch"] = "mipsel"
@@ -1,5 +1,6 @@
 #ifndef LIBAPI_H
 #define LIBAPI_H
+struct EXEC;
 extern void InitHeap(unsigned long*, unsigned long);
 extern long Load(char*, struct EXEC*);
 extern long Exec(struct EXEC*, long, char**);
@@ -0,0 +1,54 @@
+#ifndef LIBCD_H
+#define LIBCD_H
+
+/* CD-ROM primitive commands */
+#define CdlNop 0x01
+#define CdlSetloc 0x02
+#define CdlReadN 0x06
+#define CdlPause 0x09
+#define CdlSetmode 0x0E
+#define CdlSeekL 0x15
+
+/* interrupt status */
+#define CdlNoIntr 0x00
+#define CdlDataReady 0x01
+#define CdlComplete 0x02
+#define CdlAcknowledge 0x03
+#define CdlDataEnd 0x04
+#define CdlDiskError 0x05
+
+/* status bits, result[0] */
+#define CdlStatError 0x01
+#define CdlStatStandby 0x02
+#define CdlStatSeekError 0x04
+#define CdlStatIdError 0x08
+#define CdlStatShellOpen 0x10
+#define CdlStatRead 0x20
+#define CdlStatSeek 0x40
+#define CdlStatPlay 0x80
+
+/* mode bits */
+#define CdlModeSpeed 0x80
+#define CdlModeSize1 0x20
+
+typedef struct {
+    unsigned char minute; /* minute (BCD) */
+    unsigned char second; /* second (BCD) */
+    unsigned char sector; /* sector (BCD) */
+    unsigned char track;  /* track (void) */
+} CdlLOC;
+
+typedef void (*CdlCB)(unsigned char, unsigned char*);
+
+extern int CdInit();
+extern int CdReset(int mode);
+extern int CdSync(int mode, unsigned char* result);
+extern int CdControl(unsigned char com, unsigned char* param, unsigned char* result);
+extern int CdControlB(unsigned char com, unsigned char* param, unsigned char* result);
+extern int CdGetSector(void* madr, int size);
+extern CdlLOC* CdIntToPos(int i, CdlLOC* p);
+extern int CdPosToInt(CdlLOC* p);
+extern CdlCB CdSyncCallback(CdlCB func);
+extern CdlCB CdReadyCallback(CdlCB func);
+
+#endif
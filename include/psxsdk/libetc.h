@@ -0,0 +1,7 @@
+#ifndef LIBETC_H
+#define LIBETC_H
+
+extern int VSync(int mode);
+extern int VSyncCallback(void (*f)());
+
+#endif
@@ -42,9 +42,77 @@ extern u8 D_80098788;
 #define GET_PARTS_NO(x) ((u8*)&Moji_flag3)[x]
 #define GET_SELECT_NO(x) ((u8*)&D_80098B2C)[x]
 
+// opt-in runtime features (make FEATURES=...), built into src/rock_neo/feature
+// and hooked into the retail code at boot, see the README
+#if defined(SUB_SCREEN_RESIDENT) && !defined(CD_RESIDENT)
+#define CD_RESIDENT // the files of the sub screen stay in RAM
+#endif
+#if defined(CD_RESIDENT) && !defined(CD_PREFETCH)
+#define CD_PREFETCH // resident files are pinned prefetch slots
+#endif
+#if defined(CD_PREFETCH) && !defined(CD_ASYNC)
+#define CD_ASYNC // prefetches are read when the async queue is idle
+#endif
+#if defined(CD_TRACE) && !defined(CD_ASYNC)
+#define CD_ASYNC // the trace needs the position table
+#endif
+#if defined(CD_LZ) && !defined(CD_ZERO_COPY)
+#define CD_ZERO_COPY // compressed chunks only come in through archive streaming
+#endif
+#if defined(CD_ZERO_COPY) && !defined(CD_ASYNC)
+#define CD_ASYNC // plain archives are streamed by the async raw reads
+#endif
+#if defined(MOJI_SCRIPTS) && !defined(MOJI_WINDOWS)
+#define MOJI_WINDOWS // messages are laid out into windows
+#endif
+#if defined(MOJI_WINDOWS) && !defined(MOJI_GLYPH_CACHE)
+#define MOJI_GLYPH_CACHE // the cells are sprites of cached glyphs
+#endif
+#if defined(MOJI_WINDOWS) && !defined(GPU_PRIM_RETAIN)
+#define GPU_PRIM_RETAIN // the sprites of the cells are kept from frame to frame
+#endif
+#if defined(GPU_SCREEN_CACHE) && !defined(GPU_PRIM_RETAIN)
+#define GPU_PRIM_RETAIN // the quads showing a cached screen are kept
+#endif
+#if (defined(MOJI_GLYPH_CACHE) || defined(GPU_SCREEN_CACHE)) &&               \
+    !defined(VRAM_RESERVE)
+#define VRAM_RESERVE // the atlas and the cache are in VRAM the game doesn't use
+#endif
+#if defined(GPU_OT_SORT) && !defined(GPU_OT_LAYERS)
+#define GPU_OT_LAYERS // sorts the buckets of the layers
+#endif
+#if defined(CD_ASYNC) || defined(GPU_PRIM_ARENA) ||                            \
+    defined(GPU_OT_LAYERS) || defined(GPU_LATE_FLIP) ||                        \
+    defined(GPU_SCREEN_CACHE) || defined(MOJI_GLYPH_CACHE)
+#define FEATURE_HOOKS
+#endif
+
+#include "rock_neo/gpu.h"
+
 #define PRIM_PTR(t) (*(t** )0x1F800070)
 #define PRIM_PTR_INC(t) PRIM_PTR(t); PRIM_PTR(t) = PRIM_PTR(t) + 1
 
+// typed allocation from the primitives of the frame: PRIM_ALLOC(t) bumps
+// PRIM_PTR past one t, PRIM_RESERVE(t, n) only makes sure n of them fit and
+// leaves the bump to the caller. With GPU_PRIM_ARENA they give NULL when the
+// region of the frame is full (PRIM_DROPPED), the primitive is then not drawn.
+// Without it they are the plain pointer bump and never fail
+#ifdef GPU_PRIM_ARENA
+#define PRIM_ALLOC(t)                                                          \
+    ((t*)(PRIM_PTR(u8) + sizeof(t) <= Prim_arena_limit                         \
+              ? (PRIM_PTR(u8) += sizeof(t)) - sizeof(t)                        \
+              : (u8*)Prim_arena_drop(sizeof(t))))
+#define PRIM_RESERVE(t, n)                                                     \
+    ((t*)(PRIM_PTR(u8) + sizeof(t) * (n) <= Prim_arena_limit                   \
+              ? PRIM_PTR(u8)                                                   \
+              : (u8*)Prim_arena_drop(sizeof(t) * (n))))
+#define PRIM_DROPPED(p) ((p) == 0)
+#else
+#define PRIM_ALLOC(t) PRIM_PTR_INC(t)
+#define PRIM_RESERVE(t, n) PRIM_PTR(t)
+#define PRIM_DROPPED(p) 0
+#endif
+
 typedef struct unkst_80098A28 {
     s8 xe0[3]; // tag?
     s8 unk3; // tag? (4th byte?)
@@ -3,7 +3,8 @@
 
 #include "rock_neo.h"
 
-// my guess is EXIT_SUB_BIN is part of an enumerator of all files in the CD, with the CDDATA files starting at index 3.
+// my guess is EXIT_SUB_BIN is part of an enumerator of all files in the CD,
+// with the CDDATA files starting at index 3.
 typedef enum _CD_COMB {
     ARM00L_BIN = 3,
     ARM00R_BIN,
@@ -215,4 +216,125 @@ typedef enum _CD_COMB {
 int Cd_read_comb(CD_COMB);
 s32 Cd_read_sync2();
 
+// position and size of every CD_COMB file on the disc, generated from the disc
+// image into build/cd_comb_pos.inc by tools/cdpos.py. The retail game has its
+// own table, not found yet.
+typedef struct {
+    u32 lba;
+    u32 size;
+    u32 flags;
+} CD_COMB_POS;
+// only type 0 (or CD_LZ compressed) chunks, see docs/CHUNKS.md
+#define CD_COMB_PLAIN 1
+extern CD_COMB_POS Cd_comb_pos_tbl[];
+
+#ifdef CD_ASYNC
+#define CD_ASYNC_QUEUE_SIZE 8
+
+typedef void (*CD_ASYNC_CALLBACK)(CD_COMB comb, void* dest, void* user);
+
+// queues a read, dest NULL loads the file the way Cd_read_comb does. Returns -1
+// when the queue is full. Queued reads are done in disc order, not call order:
+// a read that must come after another one (same load address) is queued from
+// the callback of the first one
+s32 Cd_read_comb_async(CD_COMB comb, void* dest, CD_ASYNC_CALLBACK callback,
+                       void* user);
+// same with a priority (higher first) and a deadline in frames after which the
+// read goes before everything else, 0 for none
+s32 Cd_read_comb_async2(CD_COMB comb, void* dest, CD_ASYNC_CALLBACK callback,
+                        void* user, u8 priority, u16 deadline);
+// starts and completes queued reads, called once per frame by the main loops
+void Cd_async_service(void);
+s32 Cd_async_busy(void);
+
+// seeks of the reads issued by the async layer and their total length in
+// sectors
+extern u32 Cd_seek_count;
+extern u32 Cd_seek_distance;
+
+// errors of the reads cd.c does itself (raw reads and CD_ZERO_COPY archives),
+// by class, for debugging. Reads through Cd_read_comb keep the retail error
+// handling
+typedef struct {
+    u32 not_ready; // lid open or no disc, a command that didn't go through
+    u32 seek;      // CdlStatSeekError
+    u32 read;      // any other CdlDiskError
+    u32 overrun;   // ring full, not an error of the disc
+    u32 retries;   // reads issued again from the first sector missing
+    u32 slowdowns; // reads that went on at single speed
+    u32 failures;  // reads given up after CD_RETRY_MAX errors on one sector
+} CD_ERROR_COUNTS;
+extern CD_ERROR_COUNTS Cd_error_counts;
+// set while the callback of a read that was given up runs, its destination
+// isn't complete
+extern u8 Cd_async_failed;
+#endif
+
+#ifdef CD_TRACE
+#define CD_TRACE_SIZE 256
+#define CD_TRACE_MAGIC 0x52544443 // "CDTR"
+
+#define CD_TRACE_READ 0 // the game asked for the file
+#define CD_TRACE_DONE 1 // the file is loaded
+
+typedef struct {
+    u32 frame; // VSync(-1)
+    u16 comb;
+    u8 event;
+    u8 pad;
+    u32 lba;
+    u32 bytes;
+} CD_TRACE_ENTRY;
+
+typedef struct {
+    u32 magic;
+    u32 count; // entries ever logged, the ring keeps the last CD_TRACE_SIZE
+    CD_TRACE_ENTRY entries[CD_TRACE_SIZE];
+} CD_TRACE_LOG;
+
+extern CD_TRACE_LOG Cd_trace;
+#endif
+
+#ifdef CD_LZ
+// decodes one sector of a compressed chunk (tools/lz.py) to out, returns the
+// end of the decoded bytes
+u8* Cd_lz_decode(u8* out, u8* in);
+#endif
+
+#ifdef CD_PREFETCH
+#ifdef CD_RESIDENT
+#define CD_PREFETCH_SLOTS 8
+#ifndef CD_RESIDENT_SIZE
+#define CD_RESIDENT_SIZE 0x30000
+#endif
+#define CD_PREFETCH_SIZE CD_RESIDENT_SIZE
+#else
+#define CD_PREFETCH_SLOTS 4
+#endif
+#ifndef CD_PREFETCH_SIZE
+// bytes of RAM for prefetched files until Cd_prefetch_init
+#define CD_PREFETCH_SIZE 0x20000
+#endif
+
+// spare RAM for prefetched files, a budget of 0 only moves the head on hints
+void Cd_prefetch_init(void* buffer, u32 budget);
+// the file will likely be read next, returns -1 if it can't be kept right now.
+// Once it's in, Cd_read_comb of it replays its chunks from RAM instead of
+// reading the disc, when they are all of a type the replay knows
+s32 Cd_prefetch_hint(CD_COMB comb);
+// forgets a hint and stops its read, -1 for all of them
+void Cd_prefetch_cancel(s32 comb);
+// Cd_read_comb calls served from RAM
+extern u32 Cd_prefetch_scattered;
+
+#ifdef CD_RESIDENT
+// hints a file and keeps it in RAM until it is unpinned or cancelled, newer
+// hints don't push it out. Returns -1 if it can't be kept
+s32 Cd_prefetch_pin(CD_COMB comb);
+// lets newer hints push a pinned file out again, -1 for all of them. The file
+// stays in RAM until they do
+void Cd_prefetch_unpin(s32 comb);
+#endif
+#endif
+
 #endif
@@ -0,0 +1,55 @@
+#ifndef ROCK_NEO_FEATURE_H
+#define ROCK_NEO_FEATURE_H
+
+#include "common.h"
+
+// The runtime features (make FEATURES=...) are built from src/rock_neo/feature
+// only, the retail translation units stay as they are. config/feature.ld links
+// them for the expansion RAM of development units (and of emulators set to 8MB)
+// at FEATURE_ADDRESS and stores them after the retail image, so no retail
+// symbol moves. Feature_boot, the entry point of such a build, copies them up
+// there and patches the retail functions they hook. tools/featurelink.py checks
+// the layout and writes the header of the executable.
+#define FEATURE_ADDRESS 0x80200000
+// a console with 2MB sees its RAM again this far up
+#define FEATURE_RAM_MIRROR 0x200000
+
+// after the copy, installs the hooks of every feature built in
+void Feature_init(void);
+// the hooks of each file of src/rock_neo/feature, installed by Feature_init
+void Cd_hook_init(void);
+void Vram_hook_init(void);
+void Gpu_hook_init(void);
+void Game_hook_init(void);
+void Sub_screen_hook_init(void);
+
+// Hooks Feature_hook writes a jump to hook over the first two instructions of a
+// retail function. With a trampoline (FEATURE_REAL_DEF) those two instructions
+// are moved there, followed by a jump to the rest of the function, and
+// FEATURE_REAL(name) calls the retail code. Without one the hook replaces the
+// function. A function that starts with a branch or that branches back to its
+// second instruction is left alone, the hook is then never called and
+// FEATURE_REAL still works.
+//
+// The host builds (make cdsim, mojibench) can't patch code, they link every
+// call to name to name##_hook with ld --wrap, and FEATURE_REAL(name) is the
+// __real_ symbol of the same option.
+#ifndef FEATURE_HOST
+#define FEATURE_REAL_DEF(name) u32 name##_real[4]
+#define FEATURE_REAL(name) ((__typeof__(&name))name##_real)
+#define FEATURE_HOOK(name) Feature_hook(name, name##_hook, name##_real)
+#define FEATURE_REPLACE(name) Feature_hook(name, name##_hook, 0)
+
+// returns -1 if the function was left alone
+s32 Feature_hook(void* target, void* hook, u32* trampoline);
+#else
+#define FEATURE_REAL_DEF(name) extern __typeof__(name) __real_##name
+#define FEATURE_REAL(name) __real_##name
+#define FEATURE_HOOK(name) 0
+#define FEATURE_REPLACE(name) 0
+#endif
+
+// hooks Feature_hook refused, for debugging
+extern u8 Feature_hook_failures;
+
+#endif
@@ -56,6 +56,8 @@ void func_80016BC0();
 void func_80016BF4();
 
 void func_800155A4(void);
+void func_80016DAC(void);
+void func_80016E90(void);
 
 // GAME_WORK tbl funcs, zero-indexed
 void func_80015634(GAME_WORK*);
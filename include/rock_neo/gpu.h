@@ -0,0 +1,210 @@
+#ifndef ROCK_NEO_GPU_H
+#define ROCK_NEO_GPU_H
+
+#include "common.h"
+
+// opt-in runtime features on the drawing side (make FEATURES=GPU_...), see the
+// README
+
+// hooked over func_80012E98, the flip of every main loop, when any runtime
+// feature is on: the per frame work of the features runs around it
+unknown_t Frame_flip(unknown_t arg);
+// flips done by Frame_flip
+extern u32 Frame_count;
+
+// links the primitives first..last, already chained through their tags, in
+// front of what the ordering table entry slot holds, like AddPrim but with one
+// read of the entry for the whole run
+#define OT_LINK_RUN(slot, first, last)                                         \
+    (*(u32*)(last) =                                                           \
+         (*(u32*)(last) & 0xFF000000) | (*(u32*)(slot) & 0xFFFFFF),            \
+     *(u32*)(slot) =                                                           \
+         (*(u32*)(slot) & 0xFF000000) | ((uintptr_t)(first) & 0xFFFFFF))
+
+#ifdef GPU_LATE_FLIP
+// retail, a frame that missed its blank waits for the next one
+#define LATE_FLIP_WAIT 0
+// a frame that missed its blank is shown as soon as it's drawn, with a tear
+#define LATE_FLIP_TEAR 1
+
+typedef struct {
+    u32 frames;
+    u32 late;     // flips that came after the blank they were meant for
+    u32 torn;     // of those, the ones shown without waiting for a blank
+    u16 vblanks;  // from the previous flip to this one, the last frame
+    u16 peak;     // the most vblanks any frame took
+} LATE_FLIP_STATS;
+
+extern u8 Late_flip;
+extern LATE_FLIP_STATS Late_flip_stats;
+#endif
+
+#ifdef GPU_PRIM_ARENA
+#ifndef GPU_PRIM_ARENA_SIZE
+#define GPU_PRIM_ARENA_SIZE 0x10000 // bytes of primitives per frame buffer
+#endif
+#ifndef GPU_PRIM_ARENA_GUARD
+#define GPU_PRIM_ARENA_GUARD 0x2000 // bytes after each region, for the asm
+#endif
+
+typedef struct {
+    u32 frames;
+    u32 used;     // bytes, the last frame
+    u32 peak;     // bytes, the most any frame used
+    u32 dropped;  // primitives PRIM_ALLOC and PRIM_RESERVE gave up on
+    // frames that went past GPU_PRIM_ARENA_SIZE through the asm, which doesn't
+    // check, into the guard
+    u32 overruns;
+    // frames that ended with PRIM_PTR outside the region and its guard, not
+    // counted
+    u32 foreign;
+} PRIM_ARENA_STATS;
+
+extern PRIM_ARENA_STATS Prim_arena_stats;
+// end of the region of the frame being built, for PRIM_ALLOC
+extern u8* Prim_arena_limit;
+// counts a primitive that didn't fit, returns NULL
+void* Prim_arena_drop(u32 size);
+#endif
+
+#ifdef GPU_PRIM_RETAIN
+// a primitive chain that is written once and only linked again in the following
+// frames, as long as the key it was built from stays the same. There is a copy
+// per ordering table, the GPU may still be drawing the previous frame from the
+// other one
+typedef struct {
+    void* copy[2];
+    void* ot[2];  // the D_80098934 each copy is linked in
+    u32 key[2];   // inputs each copy was built from
+    u8 built;     // bit per copy
+    u8 rebuild; // set by Prim_retained when the copy it gave must be written
+} PRIM_RETAINED;
+
+#define PRIM_RETAINED_DEF(name, t, n)                                          \
+    static t name##_prims[2][n];                                               \
+    static PRIM_RETAINED name = {{name##_prims[0], name##_prims[1]}}
+// the inputs changed in a way the key doesn't show, both copies are written
+// again
+#define PRIM_RETAINED_DIRTY(r) ((r).built = 0)
+
+typedef struct {
+    u32 built;  // chains written
+    u32 linked; // chains only linked again
+} PRIM_RETAIN_STATS;
+
+extern PRIM_RETAIN_STATS Prim_retain_stats;
+// the copy of r for the ordering table being built, r->rebuild tells if it has
+// to be written
+void* Prim_retained(PRIM_RETAINED* r, u32 key);
+#endif
+
+#ifdef VRAM_RESERVE
+// VRAM of the features, 384x256 halfwords at 640, 256: no texture chunk of the
+// disc is uploaded there (python3 tools/vrammap.py disc.bin). The screen cache
+// takes 320x240 at 640, 256 and the glyph atlas the 4 bit page at 960, 256,
+// right of it. The LoadImage and MoveImage hooks count
+// the retail writes into it, and the features stop using it after the first
+// one. Drawing isn't checked, a drawing environment of the retail code that
+// reaches into it goes unseen
+#define VRAM_RESERVE_X 640
+#define VRAM_RESERVE_Y 256
+#define VRAM_RESERVE_W 384
+#define VRAM_RESERVE_H 256
+
+// retail LoadImage or MoveImage into the reservation, and the last such rect
+extern u32 Vram_reserve_conflicts;
+extern RECT Vram_reserve_conflict;
+// LoadImage of a feature into the reservation, not counted as a conflict
+void Vram_load(RECT* rect, unsigned long* p);
+#endif
+
+#ifdef CD_VRAM_COALESCE
+// sends the LoadImage uploads staged so far, for the hooks of anything that may
+// see VRAM
+void Cd_vram_flush(void);
+#endif
+
+#ifdef GPU_SCREEN_CACHE
+#ifndef GPU_SCREEN_CACHE_X
+// VRAM of the first cached screen, x a multiple of 64
+#define GPU_SCREEN_CACHE_X 640
+#endif
+#ifndef GPU_SCREEN_CACHE_Y
+#define GPU_SCREEN_CACHE_Y 256
+#endif
+#if GPU_SCREEN_CACHE_X < VRAM_RESERVE_X ||                                     \
+    GPU_SCREEN_CACHE_X + 320 > VRAM_RESERVE_X + VRAM_RESERVE_W - 64 ||         \
+    GPU_SCREEN_CACHE_Y < VRAM_RESERVE_Y ||                                     \
+    GPU_SCREEN_CACHE_Y + 240 > VRAM_RESERVE_Y + VRAM_RESERVE_H
+#error "the screen cache has to be in the VRAM reservation, left of the atlas"
+#endif
+
+// the static layers of a full screen, drawn once into VRAM off screen and shown
+// from there behind everything else, as long as the key they were drawn from
+// stays the same
+typedef struct {
+    PRIM_RETAINED prims; // the two POLY_FT4 that show the image
+    u32 key;
+    u32 frame; // Frame_count the screen was last drawn in
+    s16 x, y;  // VRAM of the image, 320x240
+    u8 captured;
+} SCREEN_CACHE;
+
+#define SCREEN_CACHE_DEF(name, x, y)                                           \
+    static POLY_FT4 name##_prims[2][2];                                        \
+    static SCREEN_CACHE name = {                                               \
+        {{name##_prims[0], name##_prims[1]}}, 0, 0, x, y}
+
+typedef struct {
+    u32 captures;  // screens drawn into VRAM
+    u32 shown;     // frames shown from VRAM
+    u32 fallbacks; // frames drawn the retail way, nothing cached
+} SCREEN_CACHE_STATS;
+
+extern SCREEN_CACHE_STATS Screen_cache_stats;
+// what draw adds to the retail ordering table, through the cache
+void Screen_cache_draw(SCREEN_CACHE* c, u32 key, void (*draw)());
+#endif
+
+#ifdef GPU_OT_LAYERS
+// ordering tables of their own for the C drawing code, linked into a slot of
+// the retail one (D_80098934) before every flip, from the back to the front
+typedef enum {
+    OT_LAYER_WORLD,
+    OT_LAYER_HUD,
+    OT_LAYER_TEXT,
+    OT_LAYER_FADE,
+    OT_LAYER_COUNT
+} OT_LAYER;
+
+typedef struct {
+    u16 prims; // primitives, the last frame
+    u16 runs;  // Ot_add_run calls, the last frame
+    u16 peak;  // the most primitives any frame had
+    u16 clamped; // adds deeper than the layer, put at its back
+#ifdef GPU_OT_SORT
+    // texture page or CLUT switches the GPU makes in the layer, the last frame
+    u16 changes;
+    s16 saved;    // switches the sort removed, the last frame
+    u16 unsorted; // buckets left as they were, the last frame
+#endif
+} OT_LAYER_STATS;
+
+extern OT_LAYER_STATS Ot_layer_stats[OT_LAYER_COUNT];
+// depth 0 is the front of the layer, drawn last
+void Ot_add(s32 layer, u32 depth, void* prim);
+// count primitives chained from first to last (Ot_chain), linked in one go
+void Ot_add_run(s32 layer, u32 depth, void* first, void* last, u32 count);
+// chains count primitives of size bytes laid out one after the other so that
+// they are drawn in that order, returns the last one
+void* Ot_chain(void* prims, u32 size, u32 count);
+
+#ifdef GPU_OT_SORT
+// layers whose buckets are grouped by texture page and CLUT before the flip. It
+// changes the order of the primitives of a bucket, only for layers where those
+// don't overlap
+extern u8 Ot_layer_sorted[OT_LAYER_COUNT];
+#endif
+#endif
+
+#endif
@@ -2,6 +2,7 @@
 #define ROCK_NEO_MOJI_H
 
 #include "rock_neo.h"
+#include "rock_neo/moji_glyph.h"
 
 unknown_t MojiTaskExec(unknown_t, unknown_t, unknown_t);
 s32 MojiTaskKill(); // 0x80053A30
@@ -0,0 +1,110 @@
+#ifndef ROCK_NEO_MOJI_GLYPH_H
+#define ROCK_NEO_MOJI_GLYPH_H
+
+#include "rock_neo.h"
+
+// text drawn from C (make FEATURES=MOJI_...), the retail Moji tasks are still
+// in asm, see the README
+
+#ifdef MOJI_GLYPH_CACHE
+// style bit of a glyph, the others are up to Moji_glyph_source
+// 16x16, drawn with a SPRT_16, else 8x8 with a SPRT_8
+#define MOJI_GLYPH_16 0x80
+
+typedef struct {
+    u32 hits;
+    u32 misses;    // glyphs uploaded
+    u32 evictions; // of those, the ones that took the slot of another glyph
+    u32 full;      // misses not drawn, every slot used by the last two frames
+    u32 stalls;    // DrawSync waits for a staging buffer
+} MOJI_GLYPH_STATS;
+
+extern MOJI_GLYPH_STATS Moji_glyph_stats;
+// writes the 4 bit pixels of a glyph, 16 rows of 8 bytes (an 8x8 one in the top
+// left corner), returns 0 when there is no such glyph
+extern s32 (*Moji_glyph_source)(u32 code, u32 style, u8* pixels);
+
+// v << 8 | u of the glyph in the atlas, uploaded if it wasn't there, -1 if it
+// can't be drawn
+s32 Moji_glyph(u32 code, u32 style);
+// a sprite of the glyph at x, y linked into the ordering table entry ot, NULL
+// if it can't be drawn
+void* Moji_glyph_sprt(void* ot, u32 code, u32 style, s32 x, s32 y, u16 clut);
+// sprites draw with the texture page in effect, this links the page of the
+// atlas into ot. Add it after the sprites of the same entry, it is then drawn
+// before them
+void Moji_glyph_page(void* ot);
+// Moji_glyph, and the glyph stays in the atlas until Moji_glyph_release(uv)
+s32 Moji_glyph_hold(u32 code, u32 style);
+void Moji_glyph_release(s32 uv);
+// forgets every glyph and hold, for when Moji_glyph_source changes. The
+// windows take their glyphs again
+void Moji_glyph_flush(void);
+#endif
+
+#ifdef MOJI_WINDOWS
+// a grid of character cells drawn with cached glyphs. The sprites of the cells
+// are kept between frames, only the cells whose character changed are written
+// again
+typedef struct {
+    PRIM_RETAINED prims; // SPRT_16 of every cell, chained in cell order
+    u16* text;           // the code of every cell, 0 is blank
+    u16* glyph;          // uv + 1 of the glyph each cell holds, 0 for none
+    u8* dirty;           // bit per copy of prims showing the old character
+    s16 x, y;
+    u8 cols, rows;
+    u8 style; // MOJI_GLYPH_16 draws 16x16 cells, else 8x8
+    u16 clut;
+    u8 generation; // Moji_glyph_flush count the glyphs were held in
+} MOJI_WINDOW;
+
+#define MOJI_WINDOW_DEF(name, cols, rows)                                      \
+    static u16 name##_text[(cols) * (rows)];                                   \
+    static u16 name##_glyph[(cols) * (rows)];                                  \
+    static u8 name##_dirty[(cols) * (rows)];                                   \
+    static SPRT_16 name##_prims[2][(cols) * (rows)];                           \
+    static MOJI_WINDOW name = {{{name##_prims[0], name##_prims[1]}},           \
+                               name##_text,                                    \
+                               name##_glyph,                                   \
+                               name##_dirty,                                   \
+                               0,                                              \
+                               0,                                              \
+                               cols,                                           \
+                               rows}
+
+typedef struct {
+    u32 frames;  // windows drawn
+    u32 written; // cells written again
+    u32 kept;    // cells left as they were
+} MOJI_WINDOW_STATS;
+
+extern MOJI_WINDOW_STATS Moji_window_stats;
+// places the window and blanks it
+void Moji_window_init(MOJI_WINDOW* w, s32 x, s32 y, u32 style, u16 clut);
+void Moji_window_put(MOJI_WINDOW* w, u32 col, u32 row, u32 code);
+// one cell per byte, up to the end of the row
+void Moji_window_print(MOJI_WINDOW* w, u32 col, u32 row, const char* text);
+// value right aligned in digits cells, blank padded
+void Moji_window_number(MOJI_WINDOW* w, u32 col, u32 row, u32 value,
+                        u32 digits);
+// writes the cells that changed and links the whole window into the ordering
+// table entry ot
+void Moji_window_draw(MOJI_WINDOW* w, void* ot);
+
+#ifdef MOJI_SCRIPTS
+// cells a page can have
+#define MOJI_LAYOUT_CELLS 1024
+
+// wraps text into the window at spaces, '\n' starts a row and '\f' a page.
+// Shows one page, returns the text of the next one, NULL after the last
+const char* Moji_window_text(MOJI_WINDOW* w, const char* text);
+// message index of a bank compiled by tools/msgc.py, NULL if there's no such
+// message or if the bank was compiled for a window of another size
+const u8* Moji_script_message(MOJI_WINDOW* w, const u8* bank, u32 index);
+// shows one page of a compiled message in a window of the size of the bank,
+// returns the next page the same way as Moji_window_text
+const u8* Moji_script_page(MOJI_WINDOW* w, const u8* ops);
+#endif
+#endif
+
+#endif
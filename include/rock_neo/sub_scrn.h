@@ -33,6 +33,7 @@ unknown_t func_800605DC();
 unknown_t func_80060248(SUB_SCREEN_WORK*);
 s32 func_800600CC(SUB_SCREEN_WORK*);
 void Sub_screen_shift_check(SUB_SCREEN_WORK*);
+s32 Sub_screen_cancel_check(void); /* 0x80060E64 */
 unknown_t func_80060DB8(SUB_SCREEN_WORK*);
 void Sub_screen_sort_sub(PL_WORK*, s32, s32);
 void Sub_screen_sound_reinit(PL_WORK*);
@@ -10,6 +10,12 @@ typedef unsigned short uint16_t;
 typedef unsigned int uint32_t;
 typedef unsigned int size_t;
 typedef unsigned long long uint64_t;
+#ifdef FEATURE_HOST
+// the features built for the host, where pointers may be 64 bit
+typedef __UINTPTR_TYPE__ uintptr_t;
+#else
+typedef unsigned int uintptr_t;
+#endif
 
 typedef signed char s8;
 typedef signed short s16;
@@ -0,0 +1,39 @@
+#include "common.h"
+#include "rock_neo/feature.h"
+
+// Entry point of a build with FEATURES. config/feature.ld puts this file right
+// after the retail image, where the executable loads it, and everything else of
+// src/rock_neo/feature at FEATURE_ADDRESS, stored after it. It runs before the
+// retail entry, which tools/featurelink.py writes into Feature_retail_entry,
+// and may only use its own code and data: the rest isn't copied yet, and the
+// retail startup hasn't run. The game later loads over this part of RAM.
+
+extern u32 Feature_load[];      // where the executable left the features
+extern u32 Feature_start[];     // FEATURE_ADDRESS
+extern u32 Feature_end[];
+extern u32 Feature_bss_start[];
+extern u32 Feature_bss_end[];
+
+u32 Feature_retail_entry = 0;
+u32 Feature_probe = 0;
+
+void Feature_boot(void) {
+    volatile u32* probe = &Feature_probe;
+    u32* src;
+    u32* dst;
+
+    // without the expansion RAM the write up there lands on the probe itself,
+    // and the game runs as retail
+    probe[0] = 0x46454154;
+    probe[FEATURE_RAM_MIRROR / 4] = 0;
+    if (probe[0] == 0x46454154) {
+        for (src = Feature_load, dst = Feature_start; dst < Feature_end;) {
+            *dst++ = *src++;
+        }
+        for (dst = Feature_bss_start; dst < Feature_bss_end;) {
+            *dst++ = 0;
+        }
+        Feature_init();
+    }
+    ((void (*)(void))Feature_retail_entry)();
+}
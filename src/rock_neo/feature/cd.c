@@ -0,0 +1,951 @@
+#include "rock_neo.h"
+#include "rock_neo/cd.h"
+#include "rock_neo/feature.h"
+#include "psxsdk/libcd.h"
+#include "psxsdk/libetc.h"
+
+#ifdef CD_ASYNC
+// Asynchronous Cd_read_comb
+// Requests wait in a queue and are started one after the other by
+// Cd_async_service(), which Frame_flip calls every frame, so a chain of loads
+// keeps the drive busy without anyone polling Cd_read_sync2(). The next one is
+// picked by its position on the disc, see Cd_sched_pick(). A request without
+// dest goes through Cd_read_comb() and the state machine in func_8001BB4C, the
+// chunk headers decide where the data goes, unless CD_ZERO_COPY can stream the
+// file itself. A request with a dest reads the raw file there, sector by
+// sector from the ready callback.
+
+#include "cd_comb_pos.inc"
+
+#define CD_ASYNC_IDLE 0
+#define CD_ASYNC_REQUEST_ACTIVE 1
+#define CD_ASYNC_PREFETCH_ACTIVE 2
+
+typedef struct {
+    CD_COMB comb;
+    void* dest;
+    CD_ASYNC_CALLBACK callback;
+    void* user;
+    u8 priority;
+    u16 deadline; // frames, 0 for none
+    u16 waited;
+} CD_ASYNC_REQUEST;
+
+// pending, in call order, with room for the active one to go back in
+CD_ASYNC_REQUEST Cd_async_queue[CD_ASYNC_QUEUE_SIZE + 1];
+u8 Cd_async_count;
+CD_ASYNC_REQUEST Cd_async_current;
+u8 Cd_async_active;
+u8 Cd_async_retail; // the active request went through Cd_read_comb
+u8 Cd_async_failed;
+
+// Scheduling
+// The drive head sweeps the disc like an elevator (SCAN): the next read is the
+// closest file ahead of the head in the direction it moves, and the direction
+// only turns when nothing is left ahead. Higher priorities go first, and a
+// read that waited past its deadline goes before anything else. Seeks are
+// counted for every read this file issues, to measure the loads.
+u32 Cd_sched_lba; // where the head is once the read in flight is done
+s8 Cd_sched_dir = 1;
+u32 Cd_seek_count;
+u32 Cd_seek_distance; // sectors
+
+static void Cd_sched_move(u32 lba, u32 size) {
+    if (lba != Cd_sched_lba) {
+        Cd_seek_count++;
+        Cd_seek_distance +=
+            lba > Cd_sched_lba ? lba - Cd_sched_lba : Cd_sched_lba - lba;
+    }
+    Cd_sched_lba = lba + ((size + 0x7FF) >> 11);
+}
+
+// index of the pending request to start next
+static s32 Cd_sched_pick(void) {
+    CD_ASYNC_REQUEST* req;
+    s32 best = -1;
+    s32 late = -1;
+    u32 overdue;
+    u32 best_dist;
+    u32 lba;
+    u32 dist;
+    u8 top = 0;
+    s32 pass;
+    s32 i;
+
+    for (i = 0, req = Cd_async_queue; i < Cd_async_count; i++, req++) {
+        if (req->deadline != 0 && req->waited >= req->deadline) {
+            // the most overdue one
+            if (late < 0 || req->waited - req->deadline > overdue) {
+                late = i;
+                overdue = req->waited - req->deadline;
+            }
+        }
+        if (req->priority > top) {
+            top = req->priority;
+        }
+    }
+    if (late >= 0) {
+        return late;
+    }
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 0, req = Cd_async_queue; i < Cd_async_count; i++, req++) {
+            lba = Cd_comb_pos_tbl[req->comb].lba;
+            if (req->priority != top ||
+                (Cd_sched_dir > 0 ? lba < Cd_sched_lba : lba > Cd_sched_lba)) {
+                continue;
+            }
+            dist = lba > Cd_sched_lba ? lba - Cd_sched_lba : Cd_sched_lba - lba;
+            if (best < 0 || dist < best_dist) {
+                best = i;
+                best_dist = dist;
+            }
+        }
+        if (best >= 0) {
+            break;
+        }
+        Cd_sched_dir = -Cd_sched_dir;
+    }
+    return best;
+}
+
+// Raw reads
+// Sectors go through a single producer/single consumer ring: the ready
+// callback only writes Cd_ring_head and the main loop only writes
+// Cd_ring_tail, so neither side masks interrupts. When the ring is full (or
+// the drive reports an error) the callback drops sectors and sets
+// Cd_raw_stalled, the main loop drains what it has and reads again from the
+// first sector it is missing.
+//
+// Errors are counted by class in Cd_error_counts. A sector that fails again is
+// read at single speed from its second error on, and after CD_RETRY_MAX errors
+// on the same sector the read is given up, which the callback of the request
+// sees in Cd_async_failed. A drive that isn't ready (lid open, no disc) is
+// asked again every frame without a limit.
+//
+// The callback DMAs payload sectors straight to their destination and the ring
+// slot only records it, the slot data is used for chunk headers and for what
+// can't be DMAed as is (unaligned destination, a last sector that doesn't end
+// on a word), which the main loop copies. With CD_ZERO_COPY an archive flagged
+// CD_COMB_PLAIN is streamed that way too: the callback reads each chunk header
+// and sends the chunk to its load address. With CD_LZ the sectors of a
+// compressed chunk stay in the ring, and the main loop decodes them one by one
+// to the load address.
+#ifndef CD_RING_DEPTH
+#define CD_RING_DEPTH 8 // sectors, a power of two
+#endif
+#define CD_RING_MASK (CD_RING_DEPTH - 1)
+
+#ifndef CD_RETRY_SLOW
+#define CD_RETRY_SLOW 2 // errors on a sector before it is read at single speed
+#endif
+#ifndef CD_RETRY_MAX
+#define CD_RETRY_MAX 8 // errors on a sector before the read is given up
+#endif
+
+#define CD_RAW_STALL_FULL 1      // the ring is full
+#define CD_RAW_STALL_ERROR 2     // CdlDiskError, its status in Cd_raw_status
+#define CD_RAW_STALL_NOT_READY 3 // the drive refused a command
+
+#define CD_SECTOR_DIRECT 0 // already at its destination
+#define CD_SECTOR_COPY 1   // to copy to Cd_ring_dest
+#define CD_SECTOR_HEADER 2 // a chunk header, nothing to deliver
+#define CD_SECTOR_LZ 3     // a compressed sector, to decode to Cd_lz_write
+
+#define CD_CHUNK_END 0xFFFFFFFF
+// a type 0 chunk compressed by tools/buildoverlay.py --compress
+#define CD_CHUNK_LZ 0x100
+
+u32 Cd_ring_data[CD_RING_DEPTH][0x200];
+u8* Cd_ring_dest[CD_RING_DEPTH];
+u16 Cd_ring_len[CD_RING_DEPTH];
+u8 Cd_ring_kind[CD_RING_DEPTH];
+volatile u32 Cd_ring_head;
+volatile u32 Cd_ring_tail;
+volatile u8 Cd_raw_stalled;
+volatile u32 Cd_raw_next_lba; // next sector the callback will receive
+volatile u32 Cd_raw_end_lba;
+volatile u8 Cd_raw_status;
+u8 Cd_raw_mode;
+u32 Cd_raw_error_lba;
+u8 Cd_raw_tries; // errors on Cd_raw_error_lba
+u8 Cd_raw_failed;
+CD_ERROR_COUNTS Cd_error_counts;
+
+// where the callback sends the payload, and how much is left of the file (or
+// of the chunk)
+u8 Cd_stream_archive;
+u8 Cd_stream_lz;
+u8* Cd_stream_write;
+u32 Cd_stream_left;
+
+u8 Cd_raw_reading;
+CdlCB Cd_raw_old_ready;
+
+static void Cd_raw_ready(u8 intr, u8* result) {
+    u32 head = Cd_ring_head;
+    u32 i = head & CD_RING_MASK;
+    u32* header;
+    u32 n;
+
+    if (Cd_raw_stalled) {
+        return;
+    }
+    if (intr == CdlDiskError) {
+        Cd_raw_status = result[0];
+        Cd_raw_stalled = CD_RAW_STALL_ERROR;
+        return;
+    }
+    if (intr != CdlDataReady || Cd_raw_next_lba == Cd_raw_end_lba) {
+        return;
+    }
+    if (head - Cd_ring_tail == CD_RING_DEPTH) {
+        Cd_raw_stalled = CD_RAW_STALL_FULL;
+        return;
+    }
+    if (Cd_stream_left == 0) {
+        // only archives get here, between two chunks
+        header = Cd_ring_data[i];
+        CdGetSector(header, 0x200);
+        Cd_ring_kind[i] = CD_SECTOR_HEADER;
+        if (header[0] == CD_CHUNK_END) {
+            Cd_raw_end_lba = Cd_raw_next_lba + 1;
+        } else {
+            Cd_stream_write = (u8*)(uintptr_t)header[3];
+            Cd_stream_left = header[1];
+#ifdef CD_LZ
+            Cd_stream_lz = header[0] == CD_CHUNK_LZ;
+#endif
+        }
+    } else {
+        n = Cd_stream_left < 0x800 ? Cd_stream_left : 0x800;
+        if (Cd_stream_lz) {
+            CdGetSector(Cd_ring_data[i], 0x200);
+            Cd_ring_kind[i] = CD_SECTOR_LZ;
+        } else if ((((uintptr_t)Cd_stream_write | n) & 3) == 0) {
+            CdGetSector(Cd_stream_write, n >> 2);
+            Cd_ring_kind[i] = CD_SECTOR_DIRECT;
+        } else {
+            CdGetSector(Cd_ring_data[i], 0x200);
+            Cd_ring_kind[i] = CD_SECTOR_COPY;
+            Cd_ring_dest[i] = Cd_stream_write;
+            Cd_ring_len[i] = n;
+        }
+        Cd_stream_write += n;
+        Cd_stream_left -= n;
+    }
+    Cd_raw_next_lba++;
+    Cd_ring_head = head + 1;
+}
+
+// returns 0 if the drive refused a command
+static s32 Cd_raw_seek(void) {
+    CdlLOC pos;
+
+    CdIntToPos(Cd_raw_next_lba, &pos);
+    return CdControl(CdlSetmode, &Cd_raw_mode, 0) != 0 &&
+           CdControl(CdlSetloc, (u8*)&pos, 0) != 0 &&
+           CdControl(CdlReadN, 0, 0) != 0;
+}
+
+// dest NULL streams the chunks of an archive to their load addresses
+static void Cd_raw_start(u32 lba, void* dest, u32 size) {
+    Cd_sched_move(lba, size);
+    Cd_stream_archive = dest == 0;
+    Cd_stream_lz = 0;
+    Cd_stream_write = dest;
+    Cd_stream_left = Cd_stream_archive ? 0 : size;
+    Cd_raw_next_lba = lba;
+    Cd_raw_end_lba = lba + ((size + 0x7FF) >> 11);
+    Cd_ring_head = 0;
+    Cd_ring_tail = 0;
+    Cd_raw_stalled = 0;
+    Cd_raw_mode = CdlModeSpeed;
+    Cd_raw_tries = 0;
+    Cd_raw_failed = 0;
+    Cd_raw_reading = 1;
+    Cd_raw_old_ready = CdReadyCallback(Cd_raw_ready);
+    if (!Cd_raw_seek()) {
+        Cd_raw_stalled = CD_RAW_STALL_NOT_READY;
+    }
+}
+
+#ifdef CD_LZ
+// where the main loop decodes the current compressed chunk
+u8* Cd_lz_write;
+
+// LZ4 style sequences, see tools/lz.py. No sequence crosses a sector, and
+// matches point back into what is already decoded, so the load address is the
+// whole dictionary and nothing else is kept
+u8* Cd_lz_decode(u8* out, u8* in) {
+    u8* end = in + 2 + (in[0] | (in[1] << 8));
+    u8* match;
+    u32 token;
+    u32 n;
+
+    in += 2;
+    while (in < end) {
+        token = *in++;
+        n = token >> 4;
+        if (n == 15) {
+            do {
+                n += *in;
+            } while (*in++ == 255);
+        }
+        while (n != 0) {
+            *out++ = *in++;
+            n--;
+        }
+        if (in >= end) {
+            break;
+        }
+        match = out - (in[0] | (in[1] << 8));
+        in += 2;
+        n = token & 15;
+        if (n == 15) {
+            do {
+                n += *in;
+            } while (*in++ == 255);
+        }
+        // byte by byte, a match can overlap what it writes
+        n += 4;
+        while (n != 0) {
+            *out++ = *match++;
+            n--;
+        }
+    }
+    return out;
+}
+#endif
+
+static void Cd_raw_stop(void) {
+    CdControl(CdlPause, 0, 0);
+    CdReadyCallback(Cd_raw_old_ready);
+    Cd_raw_reading = 0;
+}
+
+// counts the error that stalled the read, returns 1 if the read is given up
+static s32 Cd_raw_error(void) {
+    if (Cd_raw_stalled == CD_RAW_STALL_FULL) {
+        Cd_error_counts.overrun++;
+        return 0;
+    }
+    if (Cd_raw_stalled == CD_RAW_STALL_NOT_READY ||
+        (Cd_raw_status & CdlStatShellOpen)) {
+        Cd_error_counts.not_ready++;
+        return 0;
+    }
+    if (Cd_raw_status & CdlStatSeekError) {
+        Cd_error_counts.seek++;
+    } else {
+        Cd_error_counts.read++;
+    }
+    if (Cd_raw_next_lba != Cd_raw_error_lba) {
+        Cd_raw_error_lba = Cd_raw_next_lba;
+        Cd_raw_tries = 0;
+    }
+    if (++Cd_raw_tries >= CD_RETRY_MAX) {
+        Cd_error_counts.failures++;
+        return 1;
+    }
+    if (Cd_raw_tries >= CD_RETRY_SLOW && (Cd_raw_mode & CdlModeSpeed)) {
+        // for the rest of this read
+        Cd_raw_mode &= ~CdlModeSpeed;
+        Cd_error_counts.slowdowns++;
+    }
+    Cd_error_counts.retries++;
+    return 0;
+}
+
+// drains the ring, returns 1 once the raw read is complete or given up
+// (Cd_raw_failed)
+static s32 Cd_raw_poll(void) {
+    u32 tail;
+    u32 i;
+
+    if (!Cd_raw_reading) {
+        return 1;
+    }
+    for (tail = Cd_ring_tail; tail != Cd_ring_head; tail++) {
+        i = tail & CD_RING_MASK;
+        switch (Cd_ring_kind[i]) {
+        case CD_SECTOR_COPY:
+            memcpy(Cd_ring_dest[i], (u8*)Cd_ring_data[i], Cd_ring_len[i]);
+            break;
+#ifdef CD_LZ
+        case CD_SECTOR_HEADER:
+            Cd_lz_write = (u8*)(uintptr_t)Cd_ring_data[i][3];
+            break;
+        case CD_SECTOR_LZ:
+            Cd_lz_write = Cd_lz_decode(Cd_lz_write, (u8*)Cd_ring_data[i]);
+            break;
+#endif
+        }
+        Cd_ring_tail = tail + 1;
+    }
+    if (Cd_raw_next_lba == Cd_raw_end_lba) {
+        Cd_raw_stop();
+        if (Cd_stream_archive) {
+            // the chunks may be code
+            FlushCache();
+        }
+        return 1;
+    }
+    if (Cd_raw_stalled) {
+        if (Cd_raw_error()) {
+            Cd_raw_stop();
+            Cd_raw_failed = 1;
+            return 1;
+        }
+        // the callback ignores everything until the new read is issued
+        CdControl(CdlPause, 0, 0);
+        Cd_raw_stalled = Cd_raw_seek() ? 0 : CD_RAW_STALL_NOT_READY;
+    }
+    return 0;
+}
+
+static void Cd_raw_abort(void) {
+    if (Cd_raw_reading) {
+        Cd_raw_stop();
+    }
+}
+
+#ifdef CD_PREFETCH
+// Speculative prefetch
+// Game code hints the file it is likely to need next. While the drive is idle
+// the file is read into the spare RAM given to Cd_prefetch_init(), and a later
+// raw read of it is a copy. Cd_read_comb() of it replays its chunks from RAM
+// the way the retail loader would place them, see Cd_prefetch_scatter(). For
+// files bigger than the budget the hint only moves the head to the file. Any
+// read the game asks for cancels the prefetch in flight, see
+// Cd_read_comb_hook. With CD_RESIDENT a pinned file stays until it is unpinned
+// or cancelled.
+
+#define CD_PREFETCH_FREE 0
+#define CD_PREFETCH_WAIT 1
+#define CD_PREFETCH_LOAD 2
+#define CD_PREFETCH_READY 3
+
+typedef struct {
+    s16 comb;
+    u8 state;
+    u8 pinned; // not dropped for newer hints
+    u32 offset;
+    u32 size;
+} CD_PREFETCH_SLOT;
+
+// oldest hint first, their data is packed in the same order
+CD_PREFETCH_SLOT Cd_prefetch_slots[CD_PREFETCH_SLOTS];
+u8 Cd_prefetch_count;
+u32 Cd_prefetch_data[CD_PREFETCH_SIZE / 4];
+u8* Cd_prefetch_buffer = (u8*)Cd_prefetch_data;
+u32 Cd_prefetch_budget = CD_PREFETCH_SIZE;
+u32 Cd_prefetch_used;
+s16 Cd_prefetch_seek_comb = -1;
+u32 Cd_prefetch_scattered;
+
+void Cd_prefetch_init(void* buffer, u32 budget) {
+    Cd_prefetch_cancel(-1);
+    Cd_prefetch_buffer = buffer;
+    Cd_prefetch_budget = budget;
+}
+
+static CD_PREFETCH_SLOT* Cd_prefetch_find(s32 comb) {
+    u32 i;
+
+    for (i = 0; i < Cd_prefetch_count; i++) {
+        if (Cd_prefetch_slots[i].comb == comb) {
+            return &Cd_prefetch_slots[i];
+        }
+    }
+    return 0;
+}
+
+// the retail loader took the drive: the read is dropped without the pause that
+// would stop the retail one, and the ready callback is only given back if it
+// is still this file's
+static void Cd_raw_yield(void) {
+    CdlCB ready;
+
+    if (!Cd_raw_reading) {
+        return;
+    }
+    ready = CdReadyCallback(Cd_raw_old_ready);
+    if (ready != (CdlCB)Cd_raw_ready) {
+        CdReadyCallback(ready);
+    }
+    Cd_raw_reading = 0;
+}
+
+static void Cd_prefetch_stop(void) {
+    CD_PREFETCH_SLOT* slot;
+    u32 i;
+
+    if (Cd_async_active != CD_ASYNC_PREFETCH_ACTIVE) {
+        return;
+    }
+    Cd_raw_abort();
+    Cd_async_active = CD_ASYNC_IDLE;
+    // read it again from the start next time the drive is idle
+    for (i = 0, slot = Cd_prefetch_slots; i < Cd_prefetch_count; i++, slot++) {
+        if (slot->state == CD_PREFETCH_LOAD) {
+            slot->state = CD_PREFETCH_WAIT;
+        }
+    }
+}
+
+// drops a slot and packs the data of the newer ones down
+static void Cd_prefetch_drop(u32 index) {
+    CD_PREFETCH_SLOT* slot = &Cd_prefetch_slots[index];
+    u32 size = slot->size;
+    u32* src;
+    u32* dst;
+    u32 i;
+
+    // the drive would go on writing a slot that moves down, at its old place
+    for (i = index; i < Cd_prefetch_count; i++) {
+        if (Cd_prefetch_slots[i].state == CD_PREFETCH_LOAD) {
+            Cd_prefetch_stop();
+        }
+    }
+    dst = (u32*)(Cd_prefetch_buffer + slot->offset);
+    src = (u32*)(Cd_prefetch_buffer + slot->offset + size);
+    for (i = (Cd_prefetch_used - slot->offset - size) >> 2; i != 0; i--) {
+        *dst++ = *src++;
+    }
+    for (i = index + 1; i < Cd_prefetch_count; i++) {
+        Cd_prefetch_slots[i - 1] = Cd_prefetch_slots[i];
+        Cd_prefetch_slots[i - 1].offset -= size;
+    }
+    Cd_prefetch_count--;
+    Cd_prefetch_used -= size;
+}
+
+s32 Cd_prefetch_hint(CD_COMB comb) {
+    CD_PREFETCH_SLOT* slot;
+    u32 size = (Cd_comb_pos_tbl[comb].size + 3) & ~3;
+    u32 i;
+
+    if (Cd_prefetch_find(comb) != 0) {
+        return 0;
+    }
+    if (size > Cd_prefetch_budget) {
+        Cd_prefetch_seek_comb = comb;
+        return 0;
+    }
+    while (Cd_prefetch_count == CD_PREFETCH_SLOTS ||
+           Cd_prefetch_budget - Cd_prefetch_used < size) {
+        // the data of a slot being loaded can't move
+        if (Cd_async_active == CD_ASYNC_PREFETCH_ACTIVE) {
+            return -1;
+        }
+        // the oldest one that isn't pinned
+        for (i = 0; i < Cd_prefetch_count && Cd_prefetch_slots[i].pinned;
+             i++) {
+        }
+        if (i == Cd_prefetch_count) {
+            return -1;
+        }
+        Cd_prefetch_drop(i);
+    }
+    slot = &Cd_prefetch_slots[Cd_prefetch_count++];
+    slot->comb = comb;
+    slot->state = CD_PREFETCH_WAIT;
+    slot->pinned = 0;
+    slot->offset = Cd_prefetch_used;
+    slot->size = size;
+    Cd_prefetch_used += size;
+    return 0;
+}
+
+void Cd_prefetch_cancel(s32 comb) {
+    s32 i;
+
+    if (comb < 0 || Cd_prefetch_seek_comb == comb) {
+        Cd_prefetch_seek_comb = -1;
+    }
+    for (i = Cd_prefetch_count - 1; i >= 0; i--) {
+        if (comb < 0 || Cd_prefetch_slots[i].comb == comb) {
+            Cd_prefetch_drop(i);
+        }
+    }
+}
+
+// copies a prefetched file to dest, returns 0 if it isn't in RAM
+static s32 Cd_prefetch_serve(CD_COMB comb, void* dest) {
+    CD_PREFETCH_SLOT* slot = Cd_prefetch_find(comb);
+
+    if (slot == 0 || slot->state != CD_PREFETCH_READY) {
+        return 0;
+    }
+    memcpy(dest, Cd_prefetch_buffer + slot->offset, Cd_comb_pos_tbl[comb].size);
+    return 1;
+}
+
+#ifdef CD_RESIDENT
+s32 Cd_prefetch_pin(CD_COMB comb) {
+    CD_PREFETCH_SLOT* slot;
+
+    Cd_prefetch_hint(comb);
+    slot = Cd_prefetch_find(comb);
+    if (slot == 0) {
+        return -1;
+    }
+    slot->pinned = 1;
+    return 0;
+}
+
+void Cd_prefetch_unpin(s32 comb) {
+    u32 i;
+
+    for (i = 0; i < Cd_prefetch_count; i++) {
+        if (comb < 0 || Cd_prefetch_slots[i].comb == comb) {
+            Cd_prefetch_slots[i].pinned = 0;
+        }
+    }
+}
+#endif
+
+// The chunk types Cd_read_comb of a prefetched file can replay: type 0 (and
+// CD_CHUNK_LZ) goes to its load address, the texture types to their VRAM rect,
+// x, y, w, h at 0x1C as in tools/vrammap.py. Their size is w * h * 2, not the
+// one at 0x4
+#define CD_CHUNK_TEXTURE(type) ((type) == 1 || (type) == 9 || (type) == 10)
+#ifdef CD_LZ
+#define CD_CHUNK_DATA(type) ((type) == 0 || (type) == CD_CHUNK_LZ)
+#else
+#define CD_CHUNK_DATA(type) ((type) == 0)
+#endif
+
+// walks the chunks of a file in RAM and places them if apply is set, returns 0
+// on a chunk the replay doesn't know or that doesn't fit the file
+static s32 Cd_prefetch_chunks(u8* data, u8* end, s32 apply) {
+    u32* header;
+    u32 size;
+    RECT rect;
+#ifdef CD_LZ
+    u8* out;
+    u32 i;
+#endif
+
+    for (; data + 0x800 <= end; data += 0x800 + ((size + 0x7FF) & ~0x7FF)) {
+        header = (u32*)data;
+        size = header[1];
+        if (header[0] == CD_CHUNK_END) {
+            break;
+        }
+        if (CD_CHUNK_TEXTURE(header[0])) {
+            if (header[9] > 1024 || header[10] > 512 ||
+                header[7] > 1024 - header[9] || header[8] > 512 - header[10]) {
+                return 0;
+            }
+            size = header[9] * header[10] * 2;
+        } else if (!CD_CHUNK_DATA(header[0]) || header[3] < 0x80010000) {
+            return 0;
+        }
+        if (size > (u32)(end - data) - 0x800) {
+            return 0;
+        }
+        if (!apply || size == 0) {
+            continue;
+        }
+        if (CD_CHUNK_TEXTURE(header[0])) {
+            rect.x = header[7];
+            rect.y = header[8];
+            rect.w = header[9];
+            rect.h = header[10];
+            LoadImage(&rect, (unsigned long*)(data + 0x800));
+            continue;
+        }
+#ifdef CD_LZ
+        if (header[0] == CD_CHUNK_LZ) {
+            for (i = 0, out = (u8*)(uintptr_t)header[3]; i < size; i += 0x800) {
+                out = Cd_lz_decode(out, data + 0x800 + i);
+            }
+            continue;
+        }
+#endif
+        memcpy((u8*)(uintptr_t)header[3], data + 0x800, size);
+    }
+    return 1;
+}
+
+// Cd_read_comb of a file in RAM, returns 0 if it has to be read from the disc.
+// Nothing is placed unless every chunk can be
+static s32 Cd_prefetch_scatter(CD_COMB comb) {
+    CD_PREFETCH_SLOT* slot = Cd_prefetch_find(comb);
+    u8* data;
+    u8* end;
+
+    if (slot == 0 || slot->state != CD_PREFETCH_READY) {
+        return 0;
+    }
+    data = Cd_prefetch_buffer + slot->offset;
+    end = data + Cd_comb_pos_tbl[comb].size;
+    if (!Cd_prefetch_chunks(data, end, 0)) {
+        return 0;
+    }
+    Cd_prefetch_chunks(data, end, 1);
+    // the chunks may be code, and a later drop moves the data the texture
+    // uploads read
+    FlushCache();
+    DrawSync(0);
+    Cd_prefetch_scattered++;
+    return 1;
+}
+
+// runs while nothing else uses the drive
+static void Cd_prefetch_idle(void) {
+    CD_PREFETCH_SLOT* slot;
+    CdlLOC pos;
+    u32 i;
+
+    if (Cd_async_active == CD_ASYNC_PREFETCH_ACTIVE) {
+        if (Cd_read_sync2() != 0) {
+            // a read that didn't go through Cd_read_comb_hook, like one of the
+            // retail state machine, owns the drive now
+            Cd_raw_yield();
+            Cd_prefetch_stop();
+            return;
+        }
+        if (!Cd_raw_poll()) {
+            return;
+        }
+        Cd_async_active = CD_ASYNC_IDLE;
+        for (i = 0, slot = Cd_prefetch_slots; i < Cd_prefetch_count;
+             i++, slot++) {
+            if (slot->state == CD_PREFETCH_LOAD) {
+                slot->state = CD_PREFETCH_READY;
+                if (Cd_raw_failed) {
+                    // the game will read it itself
+                    Cd_prefetch_drop(i);
+                }
+                break;
+            }
+        }
+    }
+    if (Cd_read_sync2() != 0) {
+        return;
+    }
+    for (i = 0, slot = Cd_prefetch_slots; i < Cd_prefetch_count; i++, slot++) {
+        if (slot->state == CD_PREFETCH_WAIT) {
+            slot->state = CD_PREFETCH_LOAD;
+            Cd_async_active = CD_ASYNC_PREFETCH_ACTIVE;
+            Cd_raw_start(Cd_comb_pos_tbl[slot->comb].lba,
+                         Cd_prefetch_buffer + slot->offset,
+                         Cd_comb_pos_tbl[slot->comb].size);
+            return;
+        }
+    }
+    if (Cd_prefetch_seek_comb >= 0) {
+        CdIntToPos(Cd_comb_pos_tbl[Cd_prefetch_seek_comb].lba, &pos);
+        CdControl(CdlSetloc, (u8*)&pos, 0);
+        CdControl(CdlSeekL, 0, 0);
+        Cd_sched_move(Cd_comb_pos_tbl[Cd_prefetch_seek_comb].lba, 0);
+        Cd_prefetch_seek_comb = -1;
+    }
+}
+
+#endif
+
+#ifdef CD_TRACE
+// Access trace
+// Every file the game reads is logged with the frame it was asked for and the
+// frame it was done, in a ring that a RAM dump (or build/cdsim --trace) takes
+// off the console. tools/cdlayout.py finds it by its magic and reorders the
+// disc from it.
+CD_TRACE_LOG Cd_trace = {CD_TRACE_MAGIC};
+s16 Cd_trace_retail = -1; // the file Cd_read_comb is reading
+
+FEATURE_REAL_DEF(Cd_read_sync2);
+
+static void Cd_trace_record(CD_COMB comb, u8 event) {
+    CD_TRACE_ENTRY* entry = &Cd_trace.entries[Cd_trace.count++ % CD_TRACE_SIZE];
+
+    entry->frame = VSync(-1);
+    entry->comb = comb;
+    entry->event = event;
+    entry->lba = Cd_comb_pos_tbl[comb].lba;
+    entry->bytes = Cd_comb_pos_tbl[comb].size;
+}
+#define CD_TRACE_RECORD(comb, event) Cd_trace_record(comb, event)
+
+// Cd_read_sync2 is hooked too, to see the end of Cd_read_comb reads
+s32 Cd_read_sync2_hook() {
+    s32 busy = FEATURE_REAL(Cd_read_sync2)();
+
+    if (busy == 0 && Cd_trace_retail >= 0) {
+        Cd_trace_record(Cd_trace_retail, CD_TRACE_DONE);
+        Cd_trace_retail = -1;
+    }
+    return busy;
+}
+#else
+#define CD_TRACE_RECORD(comb, event)
+#endif
+
+FEATURE_REAL_DEF(Cd_read_comb);
+
+// the game's Cd_read_comb takes the drive from the active request: its read is
+// stopped and it goes back to the head of the queue, to start again once
+// Cd_read_sync2() is done
+static void Cd_async_yield(void) {
+    u32 i;
+
+    if (Cd_async_active != CD_ASYNC_REQUEST_ACTIVE) {
+        return;
+    }
+    Cd_raw_abort();
+    Cd_async_active = CD_ASYNC_IDLE;
+    for (i = Cd_async_count++; i != 0; i--) {
+        Cd_async_queue[i] = Cd_async_queue[i - 1];
+    }
+    Cd_async_queue[0] = Cd_async_current;
+}
+
+// every call to Cd_read_comb, from the game, the stage overlays and this file
+int Cd_read_comb_hook(CD_COMB comb) {
+#ifdef CD_PREFETCH
+    // the drive isn't used
+    if (Cd_prefetch_scatter(comb)) {
+        return 0;
+    }
+    // the game's reads come first
+    Cd_prefetch_stop();
+    if (Cd_prefetch_seek_comb == comb) {
+        Cd_prefetch_seek_comb = -1;
+    }
+#endif
+    Cd_async_yield();
+#ifdef CD_TRACE
+    Cd_trace_record(comb, CD_TRACE_READ);
+    Cd_trace_retail = comb;
+#endif
+    return FEATURE_REAL(Cd_read_comb)(comb);
+}
+
+void Cd_hook_init(void) {
+    FEATURE_HOOK(Cd_read_comb);
+#ifdef CD_TRACE
+    FEATURE_HOOK(Cd_read_sync2);
+#endif
+}
+
+s32 Cd_read_comb_async2(CD_COMB comb, void* dest, CD_ASYNC_CALLBACK callback,
+                        void* user, u8 priority, u16 deadline) {
+    CD_ASYNC_REQUEST* req;
+
+    if (Cd_async_count >= CD_ASYNC_QUEUE_SIZE) {
+        return -1;
+    }
+    req = &Cd_async_queue[Cd_async_count++];
+    req->comb = comb;
+    req->dest = dest;
+    req->callback = callback;
+    req->user = user;
+    req->priority = priority;
+    req->deadline = deadline;
+    req->waited = 0;
+    return 0;
+}
+
+s32 Cd_read_comb_async(CD_COMB comb, void* dest, CD_ASYNC_CALLBACK callback,
+                       void* user) {
+    return Cd_read_comb_async2(comb, dest, callback, user, 0, 0);
+}
+
+s32 Cd_async_busy(void) {
+    return Cd_async_count != 0 || Cd_async_active == CD_ASYNC_REQUEST_ACTIVE;
+}
+
+// The game's own Cd_read_comb owns the drive until Cd_read_sync2() says it is
+// done: a queued read started before that would cut it short. The request
+// stays queued and the next service call retries.
+static s32 Cd_async_can_start(void) {
+    return Cd_async_count != 0 && Cd_read_sync2() == 0;
+}
+
+// takes the next request out of the queue and starts it
+static void Cd_async_start(void) {
+    CD_ASYNC_REQUEST* req = &Cd_async_current;
+    s32 i = Cd_sched_pick();
+
+    *req = Cd_async_queue[i];
+    for (Cd_async_count--; i < Cd_async_count; i++) {
+        Cd_async_queue[i] = Cd_async_queue[i + 1];
+    }
+#ifdef CD_PREFETCH
+    Cd_prefetch_stop();
+#endif
+    Cd_async_retail = 0;
+    Cd_raw_failed = 0;
+    // reads through Cd_read_comb are logged by its hook
+    if (req->dest == 0) {
+#ifdef CD_ZERO_COPY
+        if (Cd_comb_pos_tbl[req->comb].flags & CD_COMB_PLAIN) {
+            CD_TRACE_RECORD(req->comb, CD_TRACE_READ);
+            Cd_async_active = CD_ASYNC_REQUEST_ACTIVE;
+            Cd_raw_start(Cd_comb_pos_tbl[req->comb].lba, 0,
+                         Cd_comb_pos_tbl[req->comb].size);
+            return;
+        }
+#endif
+        Cd_async_retail = 1;
+        Cd_sched_move(Cd_comb_pos_tbl[req->comb].lba,
+                      Cd_comb_pos_tbl[req->comb].size);
+        // only active once it's in, the hook yields an active request
+        Cd_read_comb(req->comb);
+        Cd_async_active = CD_ASYNC_REQUEST_ACTIVE;
+        return;
+    }
+    CD_TRACE_RECORD(req->comb, CD_TRACE_READ);
+    Cd_async_active = CD_ASYNC_REQUEST_ACTIVE;
+#ifdef CD_PREFETCH
+    if (Cd_prefetch_serve(req->comb, req->dest)) {
+        return;
+    }
+#endif
+    Cd_raw_start(Cd_comb_pos_tbl[req->comb].lba, req->dest,
+                 Cd_comb_pos_tbl[req->comb].size);
+}
+
+void Cd_async_service(void) {
+    CD_ASYNC_REQUEST done;
+    u32 i;
+
+    for (i = 0; i < Cd_async_count; i++) {
+        if (Cd_async_queue[i].waited != 0xFFFF) {
+            Cd_async_queue[i].waited++;
+        }
+    }
+    if (Cd_async_active == CD_ASYNC_REQUEST_ACTIVE) {
+        if (Cd_async_retail ? Cd_read_sync2() != 0 : !Cd_raw_poll()) {
+            return;
+        }
+        done = Cd_async_current;
+        Cd_async_active = CD_ASYNC_IDLE;
+        Cd_async_failed = !Cd_async_retail && Cd_raw_failed;
+        if (!Cd_async_retail) {
+            CD_TRACE_RECORD(done.comb, CD_TRACE_DONE);
+        }
+        // the next read goes out before the callback runs, so the drive
+        // doesn't wait on it
+        if (Cd_async_can_start()) {
+            Cd_async_start();
+        }
+        if (done.callback != 0) {
+            done.callback(done.comb, done.dest, done.user);
+        }
+        Cd_async_failed = 0;
+        return;
+    }
+    if (Cd_async_count != 0) {
+        if (Cd_async_can_start()) {
+            Cd_async_start();
+        }
+        return;
+    }
+#ifdef CD_PREFETCH
+    Cd_prefetch_idle();
+#endif
+}
+#endif
@@ -0,0 +1,97 @@
+#include "rock_neo.h"
+#include "rock_neo/feature.h"
+
+// Hooks into the retail code, see include/rock_neo/feature.h. Feature_init runs
+// once from Feature_boot, before the retail startup, so nothing it patches has
+// been called yet.
+
+#define MIPS_J(addr) (0x08000000 | (((u32)(addr) >> 2) & 0x03FFFFFF))
+#define MIPS_NOP 0
+
+// instructions past the entry that are searched for a branch back to the second
+// one
+#define FEATURE_HOOK_SCAN 256
+
+u8 Feature_hook_failures;
+
+// 1 for the branches and jumps, which can't be moved into a trampoline
+static s32 Feature_is_branch(u32 op) {
+    switch (op >> 26) {
+    case 0: // jr, jalr
+        return (op & 0x3F) == 8 || (op & 0x3F) == 9;
+    case 1: // bltz, bgez, bltzal, bgezal
+    case 2: // j
+    case 3: // jal
+    case 4: // beq
+    case 5: // bne
+    case 6: // blez
+    case 7: // bgtz
+        return 1;
+    case 0x10: // bc0f, bc0t ...
+    case 0x11:
+    case 0x12:
+    case 0x13:
+        return ((op >> 21) & 0x1F) == 8;
+    }
+    return 0;
+}
+
+s32 Feature_hook(void* target, void* hook, u32* trampoline) {
+    u32* code = target;
+    u32 op;
+    s32 i;
+
+    if (Feature_is_branch(code[0]) || Feature_is_branch(code[1])) {
+        goto refuse;
+    }
+    for (i = 2; i < FEATURE_HOOK_SCAN; i++) {
+        op = code[i];
+        // the jumps have absolute targets, only the branches are relative
+        if ((op >> 26) == 0 || (op >> 26) == 2 || (op >> 26) == 3 ||
+            !Feature_is_branch(op)) {
+            continue;
+        }
+        if (&code[i + 1] + (s16)op == &code[1]) {
+            goto refuse;
+        }
+    }
+    if (trampoline != 0) {
+        trampoline[0] = code[0];
+        trampoline[1] = code[1];
+        trampoline[2] = MIPS_J(&code[2]);
+        trampoline[3] = MIPS_NOP;
+    }
+    code[0] = MIPS_J(hook);
+    code[1] = MIPS_NOP;
+    return 0;
+
+refuse:
+    // the retail function runs as it is, through the trampoline too
+    if (trampoline != 0) {
+        trampoline[0] = MIPS_J(target);
+        trampoline[1] = MIPS_NOP;
+    }
+    Feature_hook_failures++;
+    return -1;
+}
+
+void Feature_init(void) {
+#ifdef CD_ASYNC
+    Cd_hook_init();
+#endif
+#if defined(CD_VRAM_COALESCE) || defined(VRAM_RESERVE)
+    Vram_hook_init();
+#endif
+#ifdef FEATURE_HOOKS
+    Gpu_hook_init();
+#endif
+#if defined(GPU_PRIM_RETAIN) || defined(GPU_PRIM_ARENA)
+    Game_hook_init();
+#endif
+#if defined(GPU_SCREEN_CACHE) || defined(CD_PREFETCH)
+    Sub_screen_hook_init();
+#endif
+    // the patched code and the trampolines may already be in the instruction
+    // cache
+    FlushCache();
+}
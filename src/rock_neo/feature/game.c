@@ -0,0 +1,69 @@
+#include "common.h"
+
+#include "rock_neo/feature.h"
+#include "rock_neo/game.h"
+
+// The backdrop and the letterbox with the runtime features, around the retail
+// functions of src/rock_neo/game.c. These write their primitives at PRIM_PTR
+// and add them, the hooks only decide where that is and if it happens at all
+
+#if defined(GPU_PRIM_RETAIN) || defined(GPU_PRIM_ARENA)
+#ifdef GPU_PRIM_RETAIN
+PRIM_RETAINED_DEF(Game_backdrop, POLY_FT4, 1);
+PRIM_RETAINED_DEF(Game_letterbox, UNK_PRIM_1, 2);
+
+// the retail function writes the copy instead of the primitives of the frame
+static void Game_retained_build(void* copy, void (*build)(void)) {
+    u8* ptr = PRIM_PTR(u8);
+
+    PRIM_PTR(void) = copy;
+    build();
+    PRIM_PTR(u8) = ptr;
+}
+#endif
+
+FEATURE_REAL_DEF(func_80016DAC);
+FEATURE_REAL_DEF(func_80016E90);
+
+void func_80016DAC_hook(void) {
+#ifdef GPU_PRIM_RETAIN
+    // only constants, written once per ordering table
+    POLY_FT4* p = Prim_retained(&Game_backdrop, 0);
+
+    if (!Game_backdrop.rebuild) {
+        AddPrim(&D_80098934->x78, p);
+        return;
+    }
+    Game_retained_build(p, FEATURE_REAL(func_80016DAC));
+#else
+    if (PRIM_DROPPED(PRIM_RESERVE(POLY_FT4, 1))) {
+        return;
+    }
+    FEATURE_REAL(func_80016DAC)();
+#endif
+}
+
+void func_80016E90_hook(void) {
+#ifdef GPU_PRIM_RETAIN
+    // the bars only move with x8, the second one still links to the first
+    // since they were added
+    UNK_PRIM_1* p = Prim_retained(&Game_letterbox, Game_work.x8);
+
+    if (!Game_letterbox.rebuild) {
+        OT_LINK_RUN(&D_80098934->x74, p + 1, p);
+        return;
+    }
+    Game_retained_build(p, FEATURE_REAL(func_80016E90));
+#else
+    if (PRIM_DROPPED(PRIM_RESERVE(UNK_PRIM_1, 2))) {
+        return;
+    }
+    FEATURE_REAL(func_80016E90)();
+#endif
+}
+
+void Game_hook_init(void) {
+    FEATURE_HOOK(func_80016DAC);
+    FEATURE_HOOK(func_80016E90);
+}
+#endif
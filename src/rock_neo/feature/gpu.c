@@ -0,0 +1,618 @@
+#include "rock_neo.h"
+#include "rock_neo/cd.h"
+#include "rock_neo/feature.h"
+#include "rock_neo/game.h"
+#include "psxsdk/libetc.h"
+
+#ifdef GPU_PRIM_ARENA
+// Primitive arena
+// Primitives are bumped from PRIM_PTR (scratchpad 0x1F800070), by the asm and
+// by PRIM_ALLOC. After every flip the pointer is set to the start of one of two
+// regions, the one the GPU isn't drawing from, and what the frame used is
+// recorded before the next flip. PRIM_ALLOC and PRIM_RESERVE stop at the end of
+// the region and drop what doesn't fit, and so everything after the asm went
+// past it. The asm doesn't check: each region is followed by
+// GPU_PRIM_ARENA_GUARD bytes that only its overruns write to, so they don't
+// reach the region the GPU is drawing, and are counted. The peak tells how big
+// GPU_PRIM_ARENA_SIZE really has to be.
+#define PRIM_ARENA_REGION (GPU_PRIM_ARENA_SIZE + GPU_PRIM_ARENA_GUARD)
+
+u32 Prim_arena_data[2][PRIM_ARENA_REGION / 4];
+u8 Prim_arena_index;
+u8* Prim_arena_limit = (u8*)0xFFFFFFFF; // no limit before the first flip
+PRIM_ARENA_STATS Prim_arena_stats;
+
+void* Prim_arena_drop(u32 size) {
+    Prim_arena_stats.dropped++;
+    return 0;
+}
+
+static void Prim_arena_open(void) {
+    Prim_arena_index ^= 1;
+    PRIM_PTR(u8) = (u8*)Prim_arena_data[Prim_arena_index];
+    Prim_arena_limit = PRIM_PTR(u8) + GPU_PRIM_ARENA_SIZE;
+}
+
+static void Prim_arena_close(void) {
+    u8* base = (u8*)Prim_arena_data[Prim_arena_index];
+    u8* p = PRIM_PTR(u8);
+    u32 used;
+
+    if (Prim_arena_limit == (u8*)0xFFFFFFFF) {
+        return;
+    }
+    // the retail code set the pointer to a buffer of its own, or the asm ran
+    // through the guard too
+    if (p < base || p > base + PRIM_ARENA_REGION) {
+        Prim_arena_stats.foreign++;
+        return;
+    }
+    used = p - base;
+    Prim_arena_stats.frames++;
+    Prim_arena_stats.used = used;
+    if (used > Prim_arena_stats.peak) {
+        Prim_arena_stats.peak = used;
+    }
+    if (p > Prim_arena_limit) {
+        Prim_arena_stats.overruns++;
+    }
+}
+#endif
+
+#ifdef GPU_PRIM_RETAIN
+// Retained primitives
+// Static geometry is written into one of the two copies of a PRIM_RETAINED the
+// first time it's drawn into an ordering table, and after that only linked
+// again with AddPrim (which keeps the length in the tag) until its key changes.
+// The copies are picked by the ordering table, not by counting frames, so flips
+// that don't go through Frame_flip can't make the GPU read a copy being
+// relinked.
+PRIM_RETAIN_STATS Prim_retain_stats;
+
+void* Prim_retained(PRIM_RETAINED* r, u32 key) {
+    s32 i;
+
+    if (r->ot[0] == D_80098934) {
+        i = 0;
+    } else if (r->ot[1] == D_80098934) {
+        i = 1;
+    } else {
+        // an ordering table not seen yet, the buffers moved if both copies
+        // are taken
+        if (r->ot[0] != 0 && r->ot[1] != 0) {
+            r->ot[0] = r->ot[1] = 0;
+            r->built = 0;
+        }
+        i = r->ot[0] != 0;
+        r->ot[i] = D_80098934;
+        r->built &= ~(1 << i);
+    }
+    r->rebuild = !(r->built & (1 << i)) || r->key[i] != key;
+    if (r->rebuild) {
+        r->built |= 1 << i;
+        r->key[i] = key;
+        Prim_retain_stats.built++;
+    } else {
+        Prim_retain_stats.linked++;
+    }
+    return r->copy[i];
+}
+#endif
+
+#ifdef GPU_OT_LAYERS
+// Ordering table layers
+// Every layer is a small reversed ordering table (ClearOTagR), one per frame
+// buffer. Primitives go in by depth, and before the flip each layer that got
+// any is linked as a single run into its slot of the retail table: one entry
+// per layer in the table the GPU walks, instead of one AddPrim into a retail
+// slot per primitive. Which slots the asm uses isn't mapped yet, the world goes
+// just in front of the backdrop (x78) and the letterbox (x74), the rest in
+// front of everything in the first slots.
+typedef struct {
+    u8 slot;  // entry of the retail table, the higher the further back
+    u8 base;  // first entry in Ot_layer_data
+    u8 depth; // entries
+} OT_LAYER_DEF;
+
+static OT_LAYER_DEF Ot_layer_tbl[OT_LAYER_COUNT] = {
+    {28, 0, 32}, // OT_LAYER_WORLD
+    {2, 32, 8},  // OT_LAYER_HUD
+    {1, 40, 4},  // OT_LAYER_TEXT
+    {0, 44, 1},  // OT_LAYER_FADE
+};
+
+#define OT_LAYER_ENTRIES 45
+
+u32 Ot_layer_data[2][OT_LAYER_ENTRIES];
+u8 Ot_layer_index = 1; // the first flip starts on buffer 0
+u8 Ot_layer_ready;
+u16 Ot_layer_count[OT_LAYER_COUNT];
+u16 Ot_layer_runs[OT_LAYER_COUNT];
+OT_LAYER_STATS Ot_layer_stats[OT_LAYER_COUNT];
+
+static u32* Ot_layer_entry(s32 layer, u32 depth) {
+    OT_LAYER_DEF* def = &Ot_layer_tbl[layer];
+
+    if (depth >= def->depth) {
+        Ot_layer_stats[layer].clamped++;
+        depth = def->depth - 1;
+    }
+    return &Ot_layer_data[Ot_layer_index][def->base + depth];
+}
+
+void Ot_add(s32 layer, u32 depth, void* prim) {
+    u32* entry = Ot_layer_entry(layer, depth);
+
+    OT_LINK_RUN(entry, prim, prim);
+    Ot_layer_count[layer]++;
+}
+
+void Ot_add_run(s32 layer, u32 depth, void* first, void* last, u32 count) {
+    u32* entry = Ot_layer_entry(layer, depth);
+
+    OT_LINK_RUN(entry, first, last);
+    Ot_layer_count[layer] += count;
+    Ot_layer_runs[layer]++;
+}
+
+void* Ot_chain(void* prims, u32 size, u32 count) {
+    u8* p = prims;
+
+    for (; count > 1; count--, p += size) {
+        *(u32*)p = (*(u32*)p & 0xFF000000) | ((u32)(p + size) & 0xFFFFFF);
+    }
+    return p;
+}
+
+// after the flip: the GPU is done with the other buffer, it takes the
+// primitives of the new frame
+static void Ot_layer_open(void) {
+    u32* data;
+    s32 i;
+
+    Ot_layer_index ^= 1;
+    data = Ot_layer_data[Ot_layer_index];
+    for (i = 0; i < OT_LAYER_COUNT; i++) {
+        ClearOTagR((unsigned long*)&data[Ot_layer_tbl[i].base],
+                   Ot_layer_tbl[i].depth);
+        Ot_layer_count[i] = 0;
+        Ot_layer_runs[i] = 0;
+    }
+    Ot_layer_ready = 1;
+}
+
+#ifdef GPU_OT_SORT
+// Draw state sort
+// Textured polygons carry their texture page and CLUT, and the GPU reloads its
+// texture cache state whenever they change from one primitive to the next. The
+// buckets of the sorted layers are grouped by page and CLUT, stable so that
+// equal keys keep their order. A bucket is left alone when it sets draw state
+// itself (DR_MODE like the ones of func_8001326C, anything past 0xE0, nested
+// tables), when it mixes sprites, which draw with the page in effect, with
+// textured polygons, or when it's bigger than OT_SORT_MAX. The switches are
+// counted on every layer, sorted or not, to measure the gain.
+#define OT_SORT_MAX 64
+
+#define OT_PRIM_PLAIN 0 // no texture
+#define OT_PRIM_POLY 1  // textured polygon, key page << 16 | CLUT
+#define OT_PRIM_SPRT 2  // textured rectangle, key CLUT
+#define OT_PRIM_STATE 3 // sets draw state or can't be followed
+
+// glyphs of the text layer don't overlap
+u8 Ot_layer_sorted[OT_LAYER_COUNT] = {0, 0, 1, 0};
+
+static u32* Ot_sort_prims[OT_SORT_MAX];
+static u32 Ot_sort_keys[OT_SORT_MAX];
+static u8 Ot_sort_class[OT_SORT_MAX];
+
+static s32 Ot_prim_class(u32* p, u32* key) {
+    u8* prim = (u8*)p;
+    u8 code = prim[7];
+
+    *key = 0;
+    if ((p[0] >> 24) == 0) {
+        return OT_PRIM_STATE;
+    }
+    switch (code >> 5) {
+    case 1:
+        // polygon, the page is next to the second uv, after its color for the
+        // gouraud ones
+        if (!(code & 4)) {
+            return OT_PRIM_PLAIN;
+        }
+        *key = *(u16*)(prim + ((code & 0x10) ? 0x1A : 0x16)) << 16 |
+               *(u16*)(prim + 0xE);
+        return OT_PRIM_POLY;
+    case 2: // line
+        return OT_PRIM_PLAIN;
+    case 3: // rectangle
+        if (!(code & 4)) {
+            return OT_PRIM_PLAIN;
+        }
+        *key = *(u16*)(prim + 0xE);
+        return OT_PRIM_SPRT;
+    }
+    return OT_PRIM_STATE;
+}
+
+// 1 when the primitive makes the GPU switch page or CLUT, state is
+// page << 16 | CLUT
+static s32 Ot_state_change(u32* state, s32 class, u32 key) {
+    u32 next;
+
+    switch (class) {
+    case OT_PRIM_POLY:
+        next = key;
+        break;
+    case OT_PRIM_SPRT:
+        next = (*state & 0xFFFF0000) | key;
+        break;
+    case OT_PRIM_STATE:
+        *state = 0xFFFFFFFF;
+        return 1;
+    default:
+        return 0;
+    }
+    if (next == *state) {
+        return 0;
+    }
+    *state = next;
+    return 1;
+}
+
+static void Ot_layer_sort(s32 layer, u32* data) {
+    OT_LAYER_DEF* def = &Ot_layer_tbl[layer];
+    OT_LAYER_STATS* stats = &Ot_layer_stats[layer];
+    u32 before_state = 0xFFFFFFFF;
+    u32 after_state = 0xFFFFFFFF;
+    u32 before = 0;
+    u32 after = 0;
+    u32 changes;
+    u32 mix;
+    u32 link;
+    u32 end;
+    u32 key;
+    u32* entry;
+    u32* p;
+    s32 class;
+    s32 i;
+    s32 j;
+    s32 k;
+    s32 n;
+
+    // in drawing order, from the back
+    for (i = def->depth - 1; i >= 0; i--) {
+        entry = &data[def->base + i];
+        end = i != 0 ? (u32)(entry - 1) & 0xFFFFFF : 0xFFFFFF;
+        n = 0;
+        mix = 0;
+        changes = 0;
+        for (link = *entry & 0xFFFFFF; link != end; link = *p & 0xFFFFFF) {
+            p = (u32*)(0x80000000 | link);
+            class = Ot_prim_class(p, &key);
+            changes += Ot_state_change(&before_state, class, key);
+            mix |= 1 << class;
+            if (n < OT_SORT_MAX) {
+                Ot_sort_prims[n] = p;
+                Ot_sort_keys[n] = key;
+                Ot_sort_class[n] = class;
+            }
+            n++;
+        }
+        before += changes;
+        if (n < 2) {
+            after_state = before_state;
+            after += changes;
+            continue;
+        }
+        if (!Ot_layer_sorted[layer] || n > OT_SORT_MAX ||
+            (mix & (1 << OT_PRIM_STATE)) ||
+            (mix & (1 << OT_PRIM_POLY) && mix & (1 << OT_PRIM_SPRT))) {
+            stats->unsorted++;
+            after_state = before_state;
+            after += changes;
+            continue;
+        }
+        // insertion sort, buckets are small and often nearly grouped already
+        for (j = 1; j < n; j++) {
+            p = Ot_sort_prims[j];
+            key = Ot_sort_keys[j];
+            class = Ot_sort_class[j];
+            for (k = j; k > 0 && Ot_sort_keys[k - 1] > key; k--) {
+                Ot_sort_prims[k] = Ot_sort_prims[k - 1];
+                Ot_sort_keys[k] = Ot_sort_keys[k - 1];
+                Ot_sort_class[k] = Ot_sort_class[k - 1];
+            }
+            Ot_sort_prims[k] = p;
+            Ot_sort_keys[k] = key;
+            Ot_sort_class[k] = class;
+        }
+        *entry = (*entry & 0xFF000000) | ((u32)Ot_sort_prims[0] & 0xFFFFFF);
+        for (j = 0; j < n; j++) {
+            p = Ot_sort_prims[j];
+            *p = (*p & 0xFF000000) |
+                 (j + 1 < n ? (u32)Ot_sort_prims[j + 1] & 0xFFFFFF : end);
+            after += Ot_state_change(&after_state, Ot_sort_class[j],
+                                     Ot_sort_keys[j]);
+        }
+    }
+    stats->changes = after;
+    stats->saved = before - after;
+}
+#endif
+
+// before the flip, the layers that aren't empty go into the retail table
+static void Ot_layer_close(void) {
+    u32* ot = (u32*)D_80098934;
+    u32* data = Ot_layer_data[Ot_layer_index];
+    OT_LAYER_DEF* def;
+    s32 i;
+
+    if (!Ot_layer_ready) {
+        return;
+    }
+    for (i = 0; i < OT_LAYER_COUNT; i++) {
+        def = &Ot_layer_tbl[i];
+#ifdef GPU_OT_SORT
+        Ot_layer_stats[i].changes = 0;
+        Ot_layer_stats[i].saved = 0;
+        Ot_layer_stats[i].unsorted = 0;
+#endif
+        if (Ot_layer_count[i] != 0) {
+#ifdef GPU_OT_SORT
+            Ot_layer_sort(i, data);
+#endif
+            OT_LINK_RUN(&ot[def->slot], &data[def->base + def->depth - 1],
+                        &data[def->base]);
+        }
+        Ot_layer_stats[i].prims = Ot_layer_count[i];
+        Ot_layer_stats[i].runs = Ot_layer_runs[i];
+        if (Ot_layer_count[i] > Ot_layer_stats[i].peak) {
+            Ot_layer_stats[i].peak = Ot_layer_count[i];
+        }
+    }
+}
+#endif
+
+#ifdef GPU_LATE_FLIP
+// Late flip
+// The flip (func_80012E98) blocks in VSync before it shows the frame. A frame
+// whose drawing spilled past the blank it was meant for then waits for the one
+// after, and the CPU sits idle for most of a frame while the GPU has nothing
+// left to do. VSync is hooked, and inside Frame_flip a late frame in
+// LATE_FLIP_TEAR only waits for the GPU to finish drawing (DrawSync) and is
+// swapped right away, in the middle of the scan out: the next frame starts a
+// blank earlier, and the late one tears. There is no third buffer, this only
+// trades the wait for the tear. LATE_FLIP_WAIT keeps the retail wait. Calls
+// outside Frame_flip are untouched.
+u8 Late_flip = LATE_FLIP_TEAR;
+LATE_FLIP_STATS Late_flip_stats;
+u8 Late_flip_in_flip;
+s32 Late_flip_last = -1; // VSync(-1) of the previous flip
+
+FEATURE_REAL_DEF(VSync);
+
+int VSync_hook(int mode) {
+    s32 now;
+    s32 ret;
+    s32 late;
+
+    // 1 and the negative modes only read the counters
+    if (!Late_flip_in_flip || mode == 1 || mode < 0) {
+        return FEATURE_REAL(VSync)(mode);
+    }
+    now = FEATURE_REAL(VSync)(-1);
+    late = Late_flip_last >= 0 &&
+           now - Late_flip_last >= (mode == 0 ? 1 : mode);
+    if (late) {
+        Late_flip_stats.late++;
+    }
+    if (late && Late_flip == LATE_FLIP_TEAR) {
+        DrawSync(0);
+        ret = FEATURE_REAL(VSync)(1);
+        Late_flip_stats.torn++;
+    } else {
+        ret = FEATURE_REAL(VSync)(mode);
+    }
+    now = FEATURE_REAL(VSync)(-1);
+    if (Late_flip_last >= 0) {
+        Late_flip_stats.vblanks = now - Late_flip_last;
+        if (Late_flip_stats.vblanks > Late_flip_stats.peak) {
+            Late_flip_stats.peak = Late_flip_stats.vblanks;
+        }
+    }
+    Late_flip_stats.frames++;
+    Late_flip_last = now;
+    return ret;
+}
+#endif
+
+#ifdef GPU_SCREEN_CACHE
+// Screen cache
+// The first frame a screen is drawn with a new key, what draw adds goes into an
+// ordering table of our own instead of the retail one. That table is linked
+// after the last primitive of the frame, behind a drawing area and offset that
+// point at the cache in VRAM, and draw is called a second time for the frame
+// itself. From the next frame on draw isn't called, two POLY_FT4 (a texture
+// page is 256 wide) show the cached image from the back of the retail table. A
+// screen that wasn't drawn the frame before is drawn again, its VRAM may have
+// been used in between. The capture leaves the GPU drawing into the cache, the
+// flip has to set the drawing environment again: PutDrawEnv is hooked and
+// nothing is cached unless the last flip called it. The cache is in the VRAM
+// reservation, after a retail write into it screens are drawn the retail way.
+#define SCREEN_CACHE_OT_SIZE 31 // entries of D_80098934
+#define SCREEN_CACHE_W 320
+#define SCREEN_CACHE_H 240
+#define SCREEN_CACHE_SHOWN 4 // screens shown in one frame
+
+typedef struct {
+    u32 tag;
+    u32 code[3];
+} SCREEN_CACHE_ENV;
+
+SCREEN_CACHE_STATS Screen_cache_stats;
+u32 Screen_cache_ot[2][SCREEN_CACHE_OT_SIZE];
+SCREEN_CACHE_ENV* Screen_cache_capture; // linked at the end of the frame
+POLY_FT4* Screen_cache_shown[SCREEN_CACHE_SHOWN];
+u8 Screen_cache_count;
+u8 Screen_cache_puts; // PutDrawEnv calls during the flip
+u8 Screen_cache_env_ok;
+
+FEATURE_REAL_DEF(PutDrawEnv);
+
+// the hook of CD_VRAM_COALESCE too, its clear is drawn right away
+DRAWENV* PutDrawEnv_hook(DRAWENV* env) {
+    Screen_cache_puts++;
+#ifdef CD_VRAM_COALESCE
+    Cd_vram_flush();
+#endif
+    return FEATURE_REAL(PutDrawEnv)(env);
+}
+
+static void Screen_cache_quads(SCREEN_CACHE* c, POLY_FT4* p) {
+    s32 i;
+
+    for (i = 0; i < 2; i++) {
+        p[i].tag[3] = 9;
+        p[i].code = 0x2D; // textured, raw
+        p[i].r0 = p[i].g0 = p[i].b0 = 0x80;
+        p[i].clut = 0;
+        p[i].tpage = GetTPage(2, 0, c->x + i * 128, c->y);
+        p[i].x0 = p[i].x2 = i * 160;
+        p[i].x1 = p[i].x3 = i * 160 + 160;
+        p[i].y0 = p[i].y1 = 0;
+        p[i].y2 = p[i].y3 = SCREEN_CACHE_H;
+        p[i].u0 = p[i].u2 = i * 32;
+        p[i].u1 = p[i].u3 = i * 32 + 160;
+        p[i].v0 = p[i].v1 = 0;
+        p[i].v2 = p[i].v3 = SCREEN_CACHE_H;
+    }
+    *(u32*)&p[0] = (*(u32*)&p[0] & 0xFF000000) | ((u32)&p[1] & 0xFFFFFF);
+}
+
+void Screen_cache_draw(SCREEN_CACHE* c, u32 key, void (*draw)()) {
+    UnkStruc_80098934* retail = D_80098934;
+    u32* ot = Screen_cache_ot[Frame_count & 1];
+    SCREEN_CACHE_ENV* env;
+    POLY_FT4* p;
+    s32 fresh = c->captured && c->key == key &&
+                c->frame + 1 == Frame_count && Vram_reserve_conflicts == 0;
+
+    c->frame = Frame_count;
+    if (fresh && Screen_cache_count < SCREEN_CACHE_SHOWN) {
+        p = Prim_retained(&c->prims, 0);
+        if (c->prims.rebuild) {
+            Screen_cache_quads(c, p);
+        }
+        Screen_cache_shown[Screen_cache_count++] = p;
+        Screen_cache_stats.shown++;
+        return;
+    }
+    c->captured = 0;
+    // one capture per frame
+    if (!Screen_cache_env_ok || Screen_cache_capture != 0 ||
+        Vram_reserve_conflicts != 0) {
+        draw();
+        Screen_cache_stats.fallbacks++;
+        return;
+    }
+    env = PRIM_ALLOC(SCREEN_CACHE_ENV);
+    if (PRIM_DROPPED(env)) {
+        draw();
+        Screen_cache_stats.fallbacks++;
+        return;
+    }
+    env->tag = 3 << 24 | ((u32)&ot[SCREEN_CACHE_OT_SIZE - 1] & 0xFFFFFF);
+    env->code[0] = 0xE3000000 | c->y << 10 | c->x;
+    env->code[1] = 0xE4000000 | (c->y + SCREEN_CACHE_H - 1) << 10 |
+                   (c->x + SCREEN_CACHE_W - 1);
+    env->code[2] = 0xE5000000 | (c->y & 0x7FF) << 11 | (c->x & 0x7FF);
+    ClearOTagR((unsigned long*)ot, SCREEN_CACHE_OT_SIZE);
+    D_80098934 = (UnkStruc_80098934*)ot;
+    draw();
+    D_80098934 = retail;
+    Screen_cache_capture = env;
+    draw();
+    c->key = key;
+    c->captured = 1;
+    Screen_cache_stats.captures++;
+}
+
+// before the flip, once everything else is in the retail table
+static void Screen_cache_close(void) {
+    u32* ot = (u32*)D_80098934;
+    u32* p;
+    s32 i;
+
+    for (i = 0; i < Screen_cache_count; i++) {
+        OT_LINK_RUN(&ot[SCREEN_CACHE_OT_SIZE - 1], Screen_cache_shown[i],
+                    Screen_cache_shown[i] + 1);
+    }
+    Screen_cache_count = 0;
+    if (Screen_cache_capture != 0) {
+        // drawn last, nothing of the frame may end up in the cache
+        for (p = ot; (*p & 0xFFFFFF) != 0xFFFFFF;
+             p = (u32*)(0x80000000 | (*p & 0xFFFFFF))) {
+        }
+        OT_LINK_RUN(p, Screen_cache_capture,
+                    &Screen_cache_ot[Frame_count & 1][0]);
+        Screen_cache_capture = 0;
+    }
+}
+#endif
+
+#ifdef FEATURE_HOOKS
+// Flip
+// func_80012E98 shows the frame that was just built, every main loop calls it
+// once per frame (and the loading waits in their loops). It is hooked, the
+// features do their per frame work around it.
+u32 Frame_count;
+
+FEATURE_REAL_DEF(func_80012E98);
+
+unknown_t Frame_flip(unknown_t arg) {
+    unknown_t ret;
+
+#ifdef CD_ASYNC
+    Cd_async_service();
+#endif
+#ifdef GPU_OT_LAYERS
+    Ot_layer_close();
+#endif
+#ifdef GPU_SCREEN_CACHE
+    Screen_cache_close();
+    Screen_cache_puts = 0;
+#endif
+#ifdef GPU_PRIM_ARENA
+    Prim_arena_close();
+#endif
+#ifdef GPU_LATE_FLIP
+    Late_flip_in_flip = 1;
+#endif
+    ret = FEATURE_REAL(func_80012E98)(arg);
+#ifdef GPU_LATE_FLIP
+    Late_flip_in_flip = 0;
+#endif
+#ifdef GPU_SCREEN_CACHE
+    Screen_cache_env_ok = Screen_cache_puts != 0;
+#endif
+#ifdef GPU_PRIM_ARENA
+    Prim_arena_open();
+#endif
+#ifdef GPU_OT_LAYERS
+    Ot_layer_open();
+#endif
+    Frame_count++;
+    return ret;
+}
+
+void Gpu_hook_init(void) {
+    Feature_hook(func_80012E98, Frame_flip, func_80012E98_real);
+#ifdef GPU_LATE_FLIP
+    FEATURE_HOOK(VSync);
+#endif
+#ifdef GPU_SCREEN_CACHE
+    FEATURE_HOOK(PutDrawEnv);
+#endif
+}
+#endif
@@ -0,0 +1,543 @@
+#include "rock_neo.h"
+#include "rock_neo/moji_glyph.h"
+
+#ifdef MOJI_GLYPH_CACHE
+// Glyph atlas
+// A 256x256 4 bit texture page of VRAM cut in 16x16 cells, each holding one
+// glyph keyed by its code and style. A glyph is rasterized by Moji_glyph_source
+// and uploaded the first time it's asked for, after that drawing it is only a
+// sprite pointing at its cell. When the atlas is full the glyph used the
+// longest ago makes room, unless it was drawn in one of the last two frames:
+// the GPU may still be reading it, the new glyph then isn't drawn this frame
+// (counted as full). Held glyphs are skipped. The uploads are queued behind the
+// drawing of the previous frame, from staging buffers that stay untouched until
+// then. Once the retail code wrote into the VRAM reservation nothing more is
+// drawn from the atlas.
+#ifndef MOJI_ATLAS_X
+// halfwords, the last page of the VRAM reservation (include/rock_neo/gpu.h)
+#define MOJI_ATLAS_X 960
+#define MOJI_ATLAS_Y 256
+#endif
+#define MOJI_GLYPH_SLOTS 256
+#define MOJI_GLYPH_HASH 64
+#define MOJI_GLYPH_STAGE 16 // uploads per frame before a DrawSync
+#define MOJI_GLYPH_NONE 0xFFFF
+#define MOJI_GLYPH_FREE 0xFFFFFFFF
+
+typedef struct {
+    u32 key;   // code << 8 | style
+    u32 frame; // Frame_count when last drawn
+    u16 next;  // in its hash bucket
+    u16 older;
+    u16 newer;
+    // Moji_glyph_hold calls not released yet, the slot can't be taken. A
+    // window holds a glyph once for each cell that shows it, a u8 would wrap
+    u16 holds;
+} MOJI_GLYPH_SLOT;
+
+MOJI_GLYPH_STATS Moji_glyph_stats;
+s32 (*Moji_glyph_source)(u32 code, u32 style, u8* pixels);
+MOJI_GLYPH_SLOT Moji_glyph_slots[MOJI_GLYPH_SLOTS];
+u16 Moji_glyph_hash[MOJI_GLYPH_HASH];
+u16 Moji_glyph_oldest;
+u16 Moji_glyph_newest;
+u8 Moji_glyph_ready;
+u8 Moji_glyph_generation; // flushes since the first use
+u32 Moji_glyph_stage[MOJI_GLYPH_STAGE][32];
+u32 Moji_glyph_stage_frame;
+u8 Moji_glyph_stage_used;
+
+void Moji_glyph_flush(void) {
+    s32 i;
+
+    // the holds go too, the windows see this and take their glyphs again
+    if (Moji_glyph_ready) {
+        Moji_glyph_generation++;
+    }
+    for (i = 0; i < MOJI_GLYPH_HASH; i++) {
+        Moji_glyph_hash[i] = MOJI_GLYPH_NONE;
+    }
+    for (i = 0; i < MOJI_GLYPH_SLOTS; i++) {
+        Moji_glyph_slots[i].key = MOJI_GLYPH_FREE;
+        Moji_glyph_slots[i].holds = 0;
+        Moji_glyph_slots[i].older = i - 1;
+        Moji_glyph_slots[i].newer = i + 1;
+    }
+    Moji_glyph_slots[0].older = MOJI_GLYPH_NONE;
+    Moji_glyph_slots[MOJI_GLYPH_SLOTS - 1].newer = MOJI_GLYPH_NONE;
+    Moji_glyph_oldest = 0;
+    Moji_glyph_newest = MOJI_GLYPH_SLOTS - 1;
+    Moji_glyph_ready = 1;
+}
+
+static u32 Moji_glyph_bucket(u32 key) {
+    return (key ^ (key >> 6) ^ (key >> 14)) & (MOJI_GLYPH_HASH - 1);
+}
+
+// moves slot i to the newest end of the LRU list
+static void Moji_glyph_touch(u32 i) {
+    MOJI_GLYPH_SLOT* slot = &Moji_glyph_slots[i];
+
+    if (i == Moji_glyph_newest) {
+        return;
+    }
+    if (slot->older != MOJI_GLYPH_NONE) {
+        Moji_glyph_slots[slot->older].newer = slot->newer;
+    } else {
+        Moji_glyph_oldest = slot->newer;
+    }
+    Moji_glyph_slots[slot->newer].older = slot->older;
+    slot->older = Moji_glyph_newest;
+    slot->newer = MOJI_GLYPH_NONE;
+    Moji_glyph_slots[Moji_glyph_newest].newer = i;
+    Moji_glyph_newest = i;
+}
+
+static void Moji_glyph_unhash(u32 i) {
+    u16* link = &Moji_glyph_hash[Moji_glyph_bucket(Moji_glyph_slots[i].key)];
+
+    while (*link != i) {
+        link = &Moji_glyph_slots[*link].next;
+    }
+    *link = Moji_glyph_slots[i].next;
+}
+
+static void Moji_glyph_upload(u32 i, u8* pixels) {
+    RECT rect;
+
+    rect.x = MOJI_ATLAS_X + (i & 15) * 4;
+    rect.y = MOJI_ATLAS_Y + (i >> 4) * 16;
+    rect.w = 4;
+    rect.h = 16;
+    Vram_load(&rect, (unsigned long*)pixels);
+}
+
+s32 Moji_glyph(u32 code, u32 style) {
+    u32 key = code << 8 | (style & 0xFF);
+    u32 bucket;
+    u32 i;
+    u8* pixels;
+    MOJI_GLYPH_SLOT* slot;
+
+    if (!Moji_glyph_ready) {
+        Moji_glyph_flush();
+    }
+    if (Vram_reserve_conflicts != 0) {
+        return -1;
+    }
+    bucket = Moji_glyph_bucket(key);
+    for (i = Moji_glyph_hash[bucket]; i != MOJI_GLYPH_NONE;
+         i = Moji_glyph_slots[i].next) {
+        if (Moji_glyph_slots[i].key == key) {
+            Moji_glyph_stats.hits++;
+            Moji_glyph_slots[i].frame = Frame_count;
+            Moji_glyph_touch(i);
+            return (i >> 4) << 12 | (i & 15) << 4;
+        }
+    }
+
+    Moji_glyph_stats.misses++;
+    for (i = Moji_glyph_oldest;
+         i != MOJI_GLYPH_NONE && Moji_glyph_slots[i].holds != 0;) {
+        i = Moji_glyph_slots[i].newer;
+    }
+    if (i == MOJI_GLYPH_NONE) {
+        Moji_glyph_stats.full++;
+        return -1;
+    }
+    slot = &Moji_glyph_slots[i];
+    if (slot->key != MOJI_GLYPH_FREE) {
+        if (slot->frame + 2 > Frame_count) {
+            Moji_glyph_stats.full++;
+            return -1;
+        }
+        Moji_glyph_unhash(i);
+        slot->key = MOJI_GLYPH_FREE;
+        Moji_glyph_stats.evictions++;
+    }
+
+    if (Moji_glyph_stage_frame != Frame_count) {
+        Moji_glyph_stage_frame = Frame_count;
+        Moji_glyph_stage_used = 0;
+    }
+    if (Moji_glyph_stage_used == MOJI_GLYPH_STAGE) {
+        // every staging buffer has an upload queued this frame
+        DrawSync(0);
+        Moji_glyph_stats.stalls++;
+        Moji_glyph_stage_used = 0;
+    }
+    pixels = (u8*)Moji_glyph_stage[Moji_glyph_stage_used];
+    if (Moji_glyph_source == 0 || !Moji_glyph_source(code, style, pixels)) {
+        return -1;
+    }
+    Moji_glyph_stage_used++;
+    Moji_glyph_upload(i, pixels);
+
+    slot->key = key;
+    slot->frame = Frame_count;
+    slot->next = Moji_glyph_hash[bucket];
+    Moji_glyph_hash[bucket] = i;
+    Moji_glyph_touch(i);
+    return (i >> 4) << 12 | (i & 15) << 4;
+}
+
+s32 Moji_glyph_hold(u32 code, u32 style) {
+    s32 uv = Moji_glyph(code, style);
+
+    if (uv >= 0) {
+        Moji_glyph_slots[(uv >> 12) << 4 | (uv >> 4 & 15)].holds++;
+    }
+    return uv;
+}
+
+void Moji_glyph_release(s32 uv) {
+    u32 i = (uv >> 12) << 4 | (uv >> 4 & 15);
+
+    // held before a flush
+    if (Moji_glyph_slots[i].holds == 0) {
+        return;
+    }
+    Moji_glyph_slots[i].holds--;
+    // it was on screen until now
+    Moji_glyph_slots[i].frame = Frame_count;
+    Moji_glyph_touch(i);
+}
+
+void* Moji_glyph_sprt(void* ot, u32 code, u32 style, s32 x, s32 y, u16 clut) {
+    SPRT_16* p; // SPRT_8 is the same but for the code
+    s32 uv = Moji_glyph(code, style);
+
+    if (uv < 0) {
+        return 0;
+    }
+    p = PRIM_ALLOC(SPRT_16);
+    if (PRIM_DROPPED(p)) {
+        return 0;
+    }
+    p->tag = 3 << 24;
+    p->code = style & MOJI_GLYPH_16 ? 0x7C : 0x74;
+    p->r0 = 0x80;
+    p->g0 = 0x80;
+    p->b0 = 0x80;
+    p->x0 = x;
+    p->y0 = y;
+    p->u0 = uv;
+    p->v0 = uv >> 8;
+    p->clut = clut;
+    AddPrim(ot, p);
+    return p;
+}
+
+void Moji_glyph_page(void* ot) {
+    DR_MODE* p;
+
+    p = PRIM_ALLOC(DR_MODE);
+    if (PRIM_DROPPED(p)) {
+        return;
+    }
+    SetDrawMode(p, 0, 0, GetTPage(0, 0, MOJI_ATLAS_X, MOJI_ATLAS_Y), 0);
+    AddPrim(ot, p);
+}
+#endif
+
+#ifdef MOJI_WINDOWS
+// Text windows
+// Every cell of a window has a sprite in each copy of a retained chain, linked
+// in cell order once when the copy is first used. A frame only writes the
+// sprites of the cells that changed since that copy was last drawn. Then it
+// links the whole chain into the ordering table with one OT_LINK_RUN.
+//
+// A blank cell keeps its place in the chain with a length of 0 in its tag, and
+// the GPU skips it. Each cell holds its glyph in the atlas. A glyph that didn't
+// fit is tried again the next frame. After Moji_glyph_flush the holds are gone:
+// the window drops its glyphs without releasing them and writes every cell
+// again.
+MOJI_WINDOW_STATS Moji_window_stats;
+
+void Moji_window_init(MOJI_WINDOW* w, s32 x, s32 y, u32 style, u16 clut) {
+    u32 i;
+
+    w->x = x;
+    w->y = y;
+    w->style = style;
+    w->clut = clut;
+    for (i = 0; i < w->cols * w->rows; i++) {
+        Moji_window_put(w, i % w->cols, i / w->cols, 0);
+        w->dirty[i] = 3;
+    }
+}
+
+// forgets the glyphs the window held before a flush
+static void Moji_window_sync(MOJI_WINDOW* w) {
+    u32 i;
+
+    if (w->generation == Moji_glyph_generation) {
+        return;
+    }
+    w->generation = Moji_glyph_generation;
+    for (i = 0; i < w->cols * w->rows; i++) {
+        if (w->glyph[i] != 0) {
+            w->glyph[i] = 0;
+            w->dirty[i] = 3;
+        }
+    }
+}
+
+void Moji_window_put(MOJI_WINDOW* w, u32 col, u32 row, u32 code) {
+    u32 i = row * w->cols + col;
+
+    Moji_window_sync(w);
+    if (col >= w->cols || row >= w->rows || w->text[i] == code) {
+        return;
+    }
+    if (w->glyph[i] != 0) {
+        Moji_glyph_release(w->glyph[i] - 1);
+        w->glyph[i] = 0;
+    }
+    w->text[i] = code;
+    w->dirty[i] = 3;
+}
+
+void Moji_window_print(MOJI_WINDOW* w, u32 col, u32 row, const char* text) {
+    for (; *text != 0 && col < w->cols; text++, col++) {
+        Moji_window_put(w, col, row, (u8)*text);
+    }
+}
+
+void Moji_window_number(MOJI_WINDOW* w, u32 col, u32 row, u32 value,
+                        u32 digits) {
+    u32 i;
+
+    for (i = digits; i > 0; i--) {
+        Moji_window_put(w, col + i - 1, row,
+                        i == digits || value != 0 ? '0' + value % 10 : ' ');
+        value /= 10;
+    }
+}
+
+// 1 when the cell shows what it should
+static s32 Moji_window_cell(MOJI_WINDOW* w, SPRT_16* p, u32 i) {
+    u32 pitch = w->style & MOJI_GLYPH_16 ? 16 : 8;
+    s32 uv;
+
+    if (w->text[i] == 0 || w->text[i] == ' ') {
+        p->tag &= 0xFFFFFF;
+        return 1;
+    }
+    if (w->glyph[i] == 0) {
+        uv = Moji_glyph_hold(w->text[i], w->style);
+        if (uv < 0) {
+            p->tag &= 0xFFFFFF;
+            return 0;
+        }
+        w->glyph[i] = uv + 1;
+    }
+    uv = w->glyph[i] - 1;
+    p->tag = (p->tag & 0xFFFFFF) | 3 << 24;
+    p->code = w->style & MOJI_GLYPH_16 ? 0x7C : 0x74;
+    p->r0 = 0x80;
+    p->g0 = 0x80;
+    p->b0 = 0x80;
+    p->x0 = w->x + i % w->cols * pitch;
+    p->y0 = w->y + i / w->cols * pitch;
+    p->u0 = uv;
+    p->v0 = uv >> 8;
+    p->clut = w->clut;
+    return 1;
+}
+
+void Moji_window_draw(MOJI_WINDOW* w, void* ot) {
+    u32 n = w->cols * w->rows;
+    SPRT_16* p = Prim_retained(&w->prims, 0);
+    u32 bit = p == w->prims.copy[0] ? 1 : 2;
+    u32 written = 0;
+    u32 i;
+
+    Moji_window_sync(w);
+    if (w->prims.rebuild) {
+        // first use of this copy: the chain, and every cell has to be written
+        for (i = 0; i < n; i++) {
+            p[i].tag = i + 1 < n ? (uintptr_t)&p[i + 1] & 0xFFFFFF : 0;
+            w->dirty[i] |= bit;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        if (!(w->dirty[i] & bit)) {
+            continue;
+        }
+        if (Moji_window_cell(w, &p[i], i)) {
+            w->dirty[i] &= ~bit;
+        }
+        written++;
+    }
+    Moji_window_stats.frames++;
+    Moji_window_stats.written += written;
+    Moji_window_stats.kept += n - written;
+    OT_LINK_RUN(ot, p, &p[n - 1]);
+    Moji_glyph_page(ot);
+}
+
+#ifdef MOJI_SCRIPTS
+// Message layout
+// A page is laid out into Moji_layout, one glyph code per cell, and copied into
+// the window with Moji_window_put so that only the cells that differ from the
+// page before are drawn again. Text is wrapped here at run time, word by word,
+// while the banks compiled by tools/msgc.py come with the wrapping, the pages
+// and the glyph codes already worked out: a page is a few rows of code runs.
+#define MOJI_OP_END 0x00
+#define MOJI_OP_ROW 0x01
+#define MOJI_OP_PAGE 0x02
+#define MOJI_OP_CODE 0x03
+#define MOJI_OP_RUN 0x80
+
+u16 Moji_layout[MOJI_LAYOUT_CELLS];
+
+// the rows of the window that fit in Moji_layout, nothing is laid out past them
+static u32 Moji_layout_rows(MOJI_WINDOW* w) {
+    u32 rows = MOJI_LAYOUT_CELLS / w->cols;
+
+    return rows < w->rows ? rows : w->rows;
+}
+
+static void Moji_layout_clear(MOJI_WINDOW* w) {
+    u32 n = w->cols * w->rows;
+    u32 i;
+
+    for (i = 0; i < n && i < MOJI_LAYOUT_CELLS; i++) {
+        Moji_layout[i] = 0;
+    }
+}
+
+static void Moji_layout_show(MOJI_WINDOW* w) {
+    u16* cell = Moji_layout;
+    u32 row;
+    u32 col;
+
+    for (row = 0; row < w->rows; row++) {
+        for (col = 0; col < w->cols && cell < &Moji_layout[MOJI_LAYOUT_CELLS];
+             col++, cell++) {
+            if (w->text[cell - Moji_layout] != *cell) {
+                Moji_window_put(w, col, row, *cell);
+            }
+        }
+    }
+}
+
+const char* Moji_window_text(MOJI_WINDOW* w, const char* text) {
+    const u8* s = (const u8*)text;
+    u16* cell;
+    s32 row = -1;
+    u32 col = 0;
+    u32 rows = Moji_layout_rows(w);
+    u32 len;
+    u32 room;
+
+    Moji_layout_clear(w);
+    while (*s != 0) {
+        // every line starts a row
+        if (row + 1 == rows) {
+            goto full;
+        }
+        row++;
+        col = 0;
+        while (*s != '\n' && *s != '\f' && *s != 0) {
+            // any other control byte separates words too, tools/msgc.py
+            // splits on the same ones
+            if (*s <= ' ') {
+                s++;
+                continue;
+            }
+            for (len = 0; s[len] > ' '; len++) {
+            }
+            if (col != 0 && col + 1 + len > w->cols) {
+                if (row + 1 == rows) {
+                    goto full;
+                }
+                row++;
+                col = 0;
+            } else if (col != 0) {
+                Moji_layout[row * w->cols + col++] = ' ';
+            }
+            // a word longer than the window is cut
+            while (col + len > w->cols) {
+                room = w->cols - col;
+                cell = &Moji_layout[row * w->cols + col];
+                for (; room != 0; room--, len--) {
+                    *cell++ = *s++;
+                }
+                if (row + 1 == rows) {
+                    goto full;
+                }
+                row++;
+                col = 0;
+            }
+            cell = &Moji_layout[row * w->cols + col];
+            for (col += len; len != 0; len--) {
+                *cell++ = *s++;
+            }
+        }
+        if (*s == '\f') {
+            Moji_layout_show(w);
+            return (const char*)s + 1;
+        }
+        if (*s == '\n') {
+            s++;
+        }
+    }
+    Moji_layout_show(w);
+    return 0;
+
+full:
+    Moji_layout_show(w);
+    return (const char*)s;
+}
+
+const u8* Moji_script_message(MOJI_WINDOW* w, const u8* bank, u32 index) {
+    // the pages were cut for a window of the size in the header
+    if (bank[0] != 'M' || bank[1] != 'S' || bank[2] != 'C' || bank[3] != '0' ||
+        bank[6] != w->cols || bank[7] != w->rows ||
+        index >= (bank[4] | bank[5] << 8)) {
+        return 0;
+    }
+    return bank + ((u32*)(bank + 8))[index];
+}
+
+const u8* Moji_script_page(MOJI_WINDOW* w, const u8* ops) {
+    u16* cell = Moji_layout;
+    u16* end = &Moji_layout[Moji_layout_rows(w) * w->cols];
+    u32 op;
+    u32 n;
+
+    Moji_layout_clear(w);
+    while (1) {
+        op = *ops++;
+        if (op & MOJI_OP_RUN) {
+            for (n = op & ~MOJI_OP_RUN; n != 0; n--, cell++, ops++) {
+                if (cell < end) {
+                    *cell = *ops;
+                }
+            }
+            continue;
+        }
+        switch (op) {
+        case MOJI_OP_ROW:
+            cell = &Moji_layout[*ops++ * w->cols];
+            break;
+        case MOJI_OP_CODE:
+            if (cell < end) {
+                *cell = ops[0] | ops[1] << 8;
+            }
+            cell++;
+            ops += 2;
+            break;
+        case MOJI_OP_PAGE:
+            Moji_layout_show(w);
+            return ops;
+        default:
+            Moji_layout_show(w);
+            return 0;
+        }
+    }
+}
+#endif
+#endif
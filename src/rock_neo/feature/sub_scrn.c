@@ -0,0 +1,102 @@
+#include "common.h"
+
+#include "rock_neo/cd.h"
+#include "rock_neo/feature.h"
+#include "rock_neo/sub_scrn.h"
+
+// The sub screen with the runtime features, around the retail functions of
+// src/rock_neo/sub_scrn.c: each hook calls the retail one and only adds what
+// the feature needs before or after it.
+
+#ifdef GPU_SCREEN_CACHE
+// the background doesn't move, only what the routines draw in front of it
+// changes
+SCREEN_CACHE_DEF(Sub_screen_back_ground_cache, GPU_SCREEN_CACHE_X,
+                 GPU_SCREEN_CACHE_Y);
+
+FEATURE_REAL_DEF(Sub_screen_back_ground_set);
+
+// drawn by func_8005EC34 every frame, before the routine of the page
+void Sub_screen_back_ground_set_hook(void) {
+    Screen_cache_draw(&Sub_screen_back_ground_cache, D_800A38F0.routine_0,
+                      FEATURE_REAL(Sub_screen_back_ground_set));
+}
+#endif
+
+#ifdef SUB_SCREEN_RESIDENT
+FEATURE_REAL_DEF(func_8005EC80);
+
+// opening the sub screen
+s32 func_8005EC80_hook(s32* arg0) {
+    s32 ret = FEATURE_REAL(func_8005EC80)(arg0);
+
+    // the files of the pages and of the way out, read while the drive is idle
+    // and kept from then on
+    Cd_prefetch_pin(SUB_WPN_BIN);
+    Cd_prefetch_pin(SUB_KEY_BIN);
+    Cd_prefetch_pin(EXIT_SUB_BIN);
+    return ret;
+}
+
+// the way out is read, later hints may take the RAM of the sub screen again.
+// The files stay in until they do, for the next time it opens
+static void Sub_screen_unpin(void) {
+    Cd_prefetch_unpin(SUB_WPN_BIN);
+    Cd_prefetch_unpin(SUB_KEY_BIN);
+    Cd_prefetch_unpin(EXIT_SUB_BIN);
+}
+
+FEATURE_REAL_DEF(Sub_screen_cancel_check);
+
+// leaving with cancel or start, from any page
+s32 Sub_screen_cancel_check_hook(void) {
+    if (FEATURE_REAL(Sub_screen_cancel_check)() == 0) {
+        return 0;
+    }
+    Sub_screen_unpin();
+    return 1;
+}
+#endif
+
+#ifdef CD_PREFETCH
+FEATURE_REAL_DEF(func_800600CC);
+
+// the weapon page: 0 reads its file, 1 sets the page up once it's in, 2 runs
+// it until the menu is left and reads the way out, 3 waits for that read
+s32 func_800600CC_hook(SUB_SCREEN_WORK* subp) {
+    u32 routine = subp->routine_1;
+    s32 ret = FEATURE_REAL(func_800600CC)(subp);
+
+#ifdef SUB_SCREEN_RESIDENT
+    if (routine == 0 && subp->routine_1 == 1) {
+        // a resident file was replayed by the read, so step 1 finds it in and
+        // sets the page up this frame instead of the next
+        routine = 1;
+        ret = FEATURE_REAL(func_800600CC)(subp);
+    }
+#endif
+    if (routine == 1 && subp->routine_1 == 2) {
+        // leaving the sub screen always loads this
+        Cd_prefetch_hint(EXIT_SUB_BIN);
+    }
+#ifdef SUB_SCREEN_RESIDENT
+    if (routine == 2 && subp->routine_1 == 3) {
+        Sub_screen_unpin();
+    }
+#endif
+    return ret;
+}
+#endif
+
+void Sub_screen_hook_init(void) {
+#ifdef GPU_SCREEN_CACHE
+    FEATURE_HOOK(Sub_screen_back_ground_set);
+#endif
+#ifdef SUB_SCREEN_RESIDENT
+    FEATURE_HOOK(func_8005EC80);
+    FEATURE_HOOK(Sub_screen_cancel_check);
+#endif
+#ifdef CD_PREFETCH
+    FEATURE_HOOK(func_800600CC);
+#endif
+}
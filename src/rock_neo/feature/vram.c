@@ -0,0 +1,249 @@
+#include "rock_neo.h"
+#include "rock_neo/feature.h"
+
+// LoadImage and MoveImage are hooked for both features of this file, the
+// upload coalescing and the check of the VRAM reservation
+
+#if defined(CD_VRAM_COALESCE) || defined(VRAM_RESERVE)
+FEATURE_REAL_DEF(LoadImage);
+FEATURE_REAL_DEF(MoveImage);
+#endif
+
+#ifdef CD_VRAM_COALESCE
+// Coalesced VRAM uploads
+// The texture states of func_8001BB4C send every sector to VRAM with its own
+// LoadImage. LoadImage is hooked: a rect that continues the pending one (same x
+// and w, starting on the row below it) is copied after it in a staging buffer,
+// and the whole rect goes out in one LoadImage once something else is
+// uploaded, the buffer is full, or before anything that may see VRAM: DrawOTag,
+// DrawSync, StoreImage, MoveImage, ClearImage and PutDrawEnv (its clear is
+// drawn right away). The caller's buffer is free as soon as
+// LoadImage returns, so the sector buffer takes the next read while the GPU DMA
+// runs. One staging buffer fills while the other one is uploaded.
+#ifndef CD_VRAM_STAGE_SIZE
+#define CD_VRAM_STAGE_SIZE 0x4000 // bytes, per staging buffer
+#endif
+
+u32 Cd_vram_stage[2][CD_VRAM_STAGE_SIZE / 4];
+RECT Cd_vram_rect; // h is 0 when nothing is staged
+u32 Cd_vram_used;
+u8 Cd_vram_index;     // the buffer being filled
+u8 Cd_vram_in_flight; // a bit per buffer handed to the GPU
+u8 Cd_vram_off; // StoreImage, MoveImage or ClearImage couldn't be hooked
+
+FEATURE_REAL_DEF(DrawOTag);
+FEATURE_REAL_DEF(DrawSync);
+FEATURE_REAL_DEF(StoreImage);
+FEATURE_REAL_DEF(ClearImage);
+
+void Cd_vram_flush(void) {
+    if (Cd_vram_rect.h == 0) {
+        return;
+    }
+    FEATURE_REAL(LoadImage)(&Cd_vram_rect,
+                            (unsigned long*)Cd_vram_stage[Cd_vram_index]);
+    Cd_vram_in_flight |= 1 << Cd_vram_index;
+    Cd_vram_index ^= 1;
+    Cd_vram_rect.h = 0;
+    Cd_vram_used = 0;
+}
+
+static int Cd_vram_load(RECT* rect, unsigned long* p) {
+    u32 size = rect->w * rect->h * 2;
+
+    if (Cd_vram_rect.h != 0 &&
+        (rect->x != Cd_vram_rect.x || rect->w != Cd_vram_rect.w ||
+         rect->y != Cd_vram_rect.y + Cd_vram_rect.h ||
+         Cd_vram_used + size > CD_VRAM_STAGE_SIZE)) {
+        Cd_vram_flush();
+    }
+    if (size == 0 || size > CD_VRAM_STAGE_SIZE || Cd_vram_off) {
+        return FEATURE_REAL(LoadImage)(rect, p);
+    }
+    if (Cd_vram_rect.h == 0) {
+        if (Cd_vram_in_flight & (1 << Cd_vram_index)) {
+            // still queued from the previous upload, DrawSync has no
+            // per-transfer wait
+            FEATURE_REAL(DrawSync)(0);
+            Cd_vram_in_flight = 0;
+        }
+        Cd_vram_rect = *rect;
+        Cd_vram_rect.h = 0;
+    }
+    memcpy((u8*)Cd_vram_stage[Cd_vram_index] + Cd_vram_used, (u8*)p, size);
+    Cd_vram_used += size;
+    Cd_vram_rect.h += rect->h;
+    return 0;
+}
+
+void DrawOTag_hook(unsigned long* p) {
+    Cd_vram_flush();
+    FEATURE_REAL(DrawOTag)(p);
+}
+
+// the staged rect is queued first, so DrawSync(0) waits for it too
+int DrawSync_hook(int mode) {
+    s32 ret;
+
+    Cd_vram_flush();
+    ret = FEATURE_REAL(DrawSync)(mode);
+    if (mode == 0) {
+        Cd_vram_in_flight = 0;
+    }
+    return ret;
+}
+
+int StoreImage_hook(RECT* rect, unsigned long* p) {
+    Cd_vram_flush();
+    return FEATURE_REAL(StoreImage)(rect, p);
+}
+
+// a staged rect sent after the clear would draw over it
+int ClearImage_hook(RECT* rect, u8 r, u8 g, u8 b) {
+    Cd_vram_flush();
+    return FEATURE_REAL(ClearImage)(rect, r, g, b);
+}
+
+#ifndef GPU_SCREEN_CACHE
+// with GPU_SCREEN_CACHE it is the hook of gpu.c that flushes
+FEATURE_REAL_DEF(PutDrawEnv);
+
+DRAWENV* PutDrawEnv_hook(DRAWENV* env) {
+    Cd_vram_flush();
+    return FEATURE_REAL(PutDrawEnv)(env);
+}
+#endif
+#else
+#define Cd_vram_flush()
+#define Cd_vram_load(rect, p) FEATURE_REAL(LoadImage)(rect, p)
+#endif
+
+#ifdef VRAM_RESERVE
+// VRAM reservation
+// See VRAM_RESERVE_X in include/rock_neo/gpu.h. tools/vrammap.py checks the
+// texture chunks of the disc, the hooks see every other upload and copy.
+u32 Vram_reserve_conflicts;
+RECT Vram_reserve_conflict;
+
+static void Vram_reserve_check(s32 x, s32 y, s32 w, s32 h) {
+    if (x < VRAM_RESERVE_X + VRAM_RESERVE_W && x + w > VRAM_RESERVE_X &&
+        y < VRAM_RESERVE_Y + VRAM_RESERVE_H && y + h > VRAM_RESERVE_Y) {
+        Vram_reserve_conflicts++;
+        Vram_reserve_conflict.x = x;
+        Vram_reserve_conflict.y = y;
+        Vram_reserve_conflict.w = w;
+        Vram_reserve_conflict.h = h;
+    }
+}
+
+void Vram_load(RECT* rect, unsigned long* p) {
+    Cd_vram_flush();
+    FEATURE_REAL(LoadImage)(rect, p);
+}
+#else
+#define Vram_reserve_check(x, y, w, h)
+#endif
+
+#if defined(CD_VRAM_COALESCE) || defined(VRAM_RESERVE)
+int LoadImage_hook(RECT* rect, unsigned long* p) {
+    Vram_reserve_check(rect->x, rect->y, rect->w, rect->h);
+    return Cd_vram_load(rect, p);
+}
+
+int MoveImage_hook(RECT* rect, int x, int y) {
+    Vram_reserve_check(x, y, rect->w, rect->h);
+    Cd_vram_flush();
+    return FEATURE_REAL(MoveImage)(rect, x, y);
+}
+
+#ifndef FEATURE_HOST
+#define MIPS_JAL(addr) (0x0C000000 | (((u32)(addr) >> 2) & 0x03FFFFFF))
+#define MIPS_LUI_A0 0x3C040000
+#define MIPS_ADDIU_A0_A0 0x24840000
+#define MIPS_ADDIU_SP_SP 0x27BD0000
+
+// libgpu, not in its header
+extern void checkRECT(char* name, RECT* rect);
+
+// StoreImage, MoveImage and ClearImage aren't in config/syms.us.rock_neo.txt.
+// libgpu has them between checkRECT and ClearOTagR, ClearImage before
+// LoadImage and the others after it, and each one starts with
+// checkRECT(name, rect): the one passing that name is the function, from its
+// stack frame setup on
+static void* Vram_find(const char* name) {
+    u32* code;
+    u32* op;
+    u32 hi;
+    u32 lo;
+    const char* s;
+    s32 i;
+
+    for (code = (u32*)checkRECT + 1; code < (u32*)ClearOTagR; code++) {
+        if (*code != MIPS_JAL(checkRECT)) {
+            continue;
+        }
+        // the name goes in a0 right before the call or in its delay slot
+        hi = 0;
+        lo = 0;
+        for (op = code - 4; op <= code + 1; op++) {
+            if ((*op & 0xFFFF0000) == MIPS_LUI_A0) {
+                hi = *op << 16;
+            } else if ((*op & 0xFFFF0000) == MIPS_ADDIU_A0_A0) {
+                lo = (s16)*op;
+            }
+        }
+        if (hi == 0) {
+            continue;
+        }
+        s = (const char*)(hi + lo);
+        for (i = 0; name[i] != 0 && name[i] == s[i]; i++) {
+        }
+        if (name[i] != s[i]) {
+            continue;
+        }
+        for (op = code; op > (u32*)checkRECT; op--) {
+            if ((*op & 0xFFFF8000) == (MIPS_ADDIU_SP_SP | 0x8000)) {
+                return op;
+            }
+        }
+    }
+    return 0;
+}
+#endif
+
+void Vram_hook_init(void) {
+#ifndef FEATURE_HOST
+    void* move = Vram_find("MoveImage");
+#ifdef CD_VRAM_COALESCE
+    void* store = Vram_find("StoreImage");
+    void* clear = Vram_find("ClearImage");
+
+    // a read back could miss a staged rect, and a clear be drawn over by one,
+    // so nothing is staged
+    if (store == 0 ||
+        Feature_hook(store, StoreImage_hook, StoreImage_real) != 0) {
+        Cd_vram_off = 1;
+    }
+    if (clear == 0 ||
+        Feature_hook(clear, ClearImage_hook, ClearImage_real) != 0) {
+        Cd_vram_off = 1;
+    }
+#endif
+    // a copy the hook doesn't see could miss a staged rect too, or go into
+    // the reservation unnoticed
+    if (move == 0 || Feature_hook(move, MoveImage_hook, MoveImage_real) != 0) {
+#ifdef CD_VRAM_COALESCE
+        Cd_vram_off = 1;
+#endif
+    }
+#endif
+    FEATURE_HOOK(LoadImage);
+#ifdef CD_VRAM_COALESCE
+    FEATURE_HOOK(DrawOTag);
+    FEATURE_HOOK(DrawSync);
+#ifndef GPU_SCREEN_CACHE
+    FEATURE_HOOK(PutDrawEnv);
+#endif
+#endif
+}
+#endif
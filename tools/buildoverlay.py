@@ -20,6 +20,7 @@
 
 import hashlib
 import os, sys, json, yaml, struct, subprocess, shutil, glob, re
+import cdpos, lz
 
 VERSION = "us"
 CROSS = "mipsel-elf-"
@@ -43,7 +44,12 @@ TOOLS_DIR       = "tools"
 MASPSX = "python3 tools/maspx/maspsx.py --no-macro-inc --expand-div"
 PYPATCHASM = "tools/patchasm.py"
 
-build_log = open(f"logs/build_{sys.argv[1]}.log", "w")
+# opened by main(), tools/watch.py imports this file for its flags
+build_log = None
+
+# chunk types that may be stored as CHUNK_LZ (FEATURES=CD_LZ). Only plain data chunks are streamed to
+# their load address by the CD layer, everything else still goes through the retail loader
+LZ_CHUNK_TYPES = [0]
 
 def list_src_files(parent_archive_file_name, chunk_file_name):
     files = []
@@ -233,7 +239,48 @@ def build_overlay(parent_archive_filename):
 
     
 
+def compress_archive(path):
+    # rewrites an archive with its chunk payloads as CHUNK_LZ where that saves sectors. Only archives
+    # made of LZ_CHUNK_TYPES chunks, that the CD layer reads itself, are touched
+    data = open(path, "rb").read()
+    offset = 0
+    chunks = []
+    while offset + 0x10 <= len(data):
+        chunk_type, chunk_size, _, load_address = struct.unpack_from("<IIII", data, offset)
+        if chunk_type == cdpos.CHUNK_END:
+            break
+        if chunk_type not in LZ_CHUNK_TYPES or load_address < 0x80010000 or offset + 0x800 + chunk_size > len(data):
+            return False
+        chunks.append((offset, chunk_size))
+        offset += 0x800 + align_up(chunk_size, 0x800)
+    else:
+        return False
+    out = bytearray()
+    for chunk_offset, chunk_size in chunks:
+        header = bytearray(data[chunk_offset:chunk_offset + 0x800])
+        payload = data[chunk_offset + 0x800:chunk_offset + 0x800 + chunk_size]
+        packed = lz.compress(payload)
+        if len(packed) < align_up(chunk_size, 0x800):
+            # 0x10 keeps the size once decoded
+            struct.pack_into("<II", header, 0, cdpos.CHUNK_LZ, len(packed))
+            struct.pack_into("<I", header, 0x10, chunk_size)
+            payload = packed
+        out += header + payload + bytes(align_up(len(payload), 0x800) - len(payload))
+    # the end marker and whatever follows it
+    out += data[offset:]
+    with open(path, "wb") as f:
+        f.write(out)
+    build_log.write(f"lz {path}: 0x{len(data):X} -> 0x{len(out):X}\n")
+    return True
+
 def main():
+    global build_log
+    build_log = open(f"logs/build_{sys.argv[1].lstrip('-')}.log", "w")
+    if sys.argv[1] == "--compress":
+        # python3 tools/buildoverlay.py --compress build/disk/CDDATA/DAT/*.BIN
+        for path in sys.argv[2:]:
+            compress_archive(path)
+        return
     # if "rock_neo.elf" not in src_files_hash_cache or src_files_hash_cache["rock_neo.elf"] != hashlib.sha256(open(f"{BUILD_DIR}/rock_neo.elf", "rb").read()).hexdigest():
     #     generate_rock_neo_syms_txt()
     parent_archive_file_name = sys.argv[1].replace(f"splat.{VERSION}.", "")
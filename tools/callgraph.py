@@ -0,0 +1,316 @@
+#!/usr/bin/env python3
+
+# Whole-program call graph of rock_neo and every overlay
+#
+# Each module is scanned in parallel, from the asm splat writes (or the retail image for data-only
+# PROGBIN chunks, with names from the built map when there is one):
+#   - jal and out-of-function j give direct calls and tail calls
+#   - %hi/%lo pairs that build a function address give "address taken" edges (callbacks)
+#   - %hi/%lo pairs that point into a `.word` function pointer table (Game_main_tbl, D_8008DBB0...)
+#     give an edge to every entry of the table, which is how the jalr dispatches get resolved
+# Targets outside the calling module are looked up in rock_neo first and then in every overlay that
+# is loaded at that address (STAGE_PROGBIN_LOAD_ADDRESS etc.). Those window edges may have several
+# callees, one per overlay sharing the window.
+#
+# The graph is written to build/callgraph.json:
+#   "modules": [name, ...]
+#   "nodes":   [[module index, name, vram, size], ...]
+#   "edges":   [[caller node, callee node, kind], ...]  kind: c call, j tail call, a address taken,
+#                                                      t table entry; uppercase when resolved through a
+#                                                      load window
+#   "tables":  {label: [module index, vram, [node, ...]]}
+# load() reads it back as a CallGraph for other tools.
+#
+# Usage: python3 tools/callgraph.py [-o build/callgraph.json] [--callers NAME] [--callees NAME]
+
+import argparse
+import bisect
+import json
+import multiprocessing
+import os
+import sys
+
+sys.path.append(os.path.dirname(os.path.realpath(__file__)))
+import mips
+import modules
+import splat_asm
+
+DEFAULT_OUTPUT = os.path.join(modules.BUILD_DIR, "callgraph.json")
+
+KIND_CALL = "c"
+KIND_TAIL = "j"
+KIND_ADDR = "a"
+KIND_TABLE = "t"
+
+
+def load_window(vram):
+    # the load address a module at vram is loaded to, None for rock_neo
+    best = None
+    for name, address in modules.LOAD_ADDRESSES.items():
+        if address <= vram and (best is None or address > modules.LOAD_ADDRESSES[best]):
+            best = name
+    return best
+
+
+def scan_function(fn):
+    """Returns [(kind, target vram)] and [hi/lo address] referenced by one function."""
+    refs = []
+    addresses = []
+    end = fn.vram + len(fn.words) * 4
+    hi = {}
+    for ins in fn.instructions():
+        if ins.mnemonic == "jal":
+            refs.append((KIND_CALL, ins.branch_target()))
+        elif ins.mnemonic == "j":
+            target = ins.branch_target()
+            if not fn.vram <= target < end:
+                refs.append((KIND_TAIL, target))
+        elif ins.kind == mips.K_HI:
+            hi[ins.rt] = ins.imm << 16
+            continue
+        elif ins.mnemonic in ("addiu", "ori") and ins.rs in hi:
+            value = hi[ins.rs] + (ins.signed_imm if ins.mnemonic == "addiu" else ins.imm)
+            addresses.append(value & 0xFFFFFFFF)
+            hi[ins.rt] = value
+            continue
+        elif ins.mnemonic == "addu" and (ins.rs in hi) != (ins.rt in hi):
+            # table base + index
+            hi[ins.rd] = hi[ins.rs] if ins.rs in hi else hi[ins.rt]
+            continue
+        elif ins.kind == mips.K_LOAD and ins.rs in hi:
+            addresses.append((hi[ins.rs] + ins.signed_imm) & 0xFFFFFFFF)
+        if ins.kind in (mips.K_BRANCH, mips.K_JUMP):
+            hi.clear()
+        else:
+            for reg in ("rt", "rd"):
+                hi.pop(getattr(ins, reg), None)
+    return refs, addresses
+
+
+def scan_module(module):
+    functions = splat_asm.module_functions(module)
+    names = {}
+    if os.path.exists(module.map_path()):
+        names = {sym.vram: sym.name for sym in modules.text_symbols(module.map_path())}
+    out_functions = []
+    refs = []
+    for fn in functions:
+        name = names.get(fn.vram, fn.name)
+        out_functions.append((name, fn.vram, len(fn.words) * 4))
+        fn_refs, addresses = scan_function(fn)
+        refs.append((fn.vram, fn_refs, addresses))
+
+    tables = {}
+    for path in splat_asm.iter_asm_files(module):
+        if os.sep + "data" + os.sep not in path:
+            continue
+        for label, vram, symbol in splat_asm.parse_data_words(path):
+            if label is None:
+                continue
+            table = tables.setdefault(label, [vram, vram, []])
+            table[0] = min(table[0], vram)
+            table[1] = max(table[1], vram + 4)
+            table[2].append(symbol)
+    return module.name, module.vram, module.size, out_functions, refs, tables
+
+
+class ModuleIndex:
+    def __init__(self, index, name, vram, size):
+        self.index = index
+        self.name = name
+        self.vram = vram
+        self.size = size
+        self.starts = []
+        self.nodes = []
+        self.by_name = {}
+        self.tables = []
+
+    def contains(self, vram):
+        if self.size is None:
+            # no retail image to size rock_neo with, it ends with its last function
+            return bool(self.starts) and self.vram <= vram <= self.starts[-1]
+        return self.vram <= vram < self.vram + self.size
+
+    def function_at(self, vram):
+        i = bisect.bisect_left(self.starts, vram)
+        if i < len(self.starts) and self.starts[i] == vram:
+            return self.nodes[i]
+        return None
+
+    def table_at(self, vram):
+        for start, end, label, entries in self.tables:
+            if start <= vram < end:
+                return label, entries
+        return None
+
+
+class CallGraph:
+    def __init__(self, data):
+        self.modules = data["modules"]
+        self.nodes = data["nodes"]
+        self.edges = data["edges"]
+        self.tables = data.get("tables", {})
+        self.callees = [[] for _ in self.nodes]
+        self.callers = [[] for _ in self.nodes]
+        for src, dst, kind in self.edges:
+            self.callees[src].append((dst, kind))
+            self.callers[dst].append((src, kind))
+        self.by_name = {}
+        for i, node in enumerate(self.nodes):
+            self.by_name.setdefault(node[1], []).append(i)
+
+    def describe(self, i):
+        module, name, vram, size = self.nodes[i]
+        return f"{name} ({self.modules[module]} 0x{vram:08X})"
+
+    def find(self, name):
+        return self.by_name.get(name, [])
+
+    def reachable(self, roots):
+        seen = set(roots)
+        stack = list(roots)
+        while stack:
+            for dst, _ in self.callees[stack.pop()]:
+                if dst not in seen:
+                    seen.add(dst)
+                    stack.append(dst)
+        return seen
+
+
+def load(path=DEFAULT_OUTPUT):
+    with open(path, "r") as f:
+        return CallGraph(json.load(f))
+
+
+def build(jobs):
+    with multiprocessing.Pool(jobs) as pool:
+        results = sorted(pool.imap_unordered(scan_module, modules.all_modules(), chunksize=4),
+                         key=lambda r: (r[0] != modules.ROCK_NEO, r[0]))
+
+    module_names = []
+    nodes = []
+    indexes = []
+    for name, vram, size, functions, _, tables in results:
+        index = ModuleIndex(len(module_names), name, vram, size)
+        module_names.append(name)
+        for fn_name, fn_vram, fn_size in functions:
+            index.starts.append(fn_vram)
+            index.nodes.append(len(nodes))
+            index.by_name[fn_name] = len(nodes)
+            nodes.append([index.index, fn_name, fn_vram, fn_size])
+        indexes.append(index)
+    rock_neo = indexes[0] if indexes and indexes[0].name == modules.ROCK_NEO else None
+
+    # overlays by load window, for calls out of the calling module
+    by_window = {}
+    for index in indexes:
+        if index is not rock_neo:
+            by_window.setdefault(load_window(index.vram), []).append(index)
+
+    def resolve(module, vram):
+        """Returns ([nodes], through a load window)."""
+        node = module.function_at(vram)
+        if node is not None:
+            return [node], False
+        if rock_neo is not None and module is not rock_neo and rock_neo.contains(vram):
+            node = rock_neo.function_at(vram)
+            return ([node] if node is not None else []), False
+        found = []
+        for other in by_window.get(load_window(vram), []):
+            if other is not module and other.contains(vram):
+                node = other.function_at(vram)
+                if node is not None:
+                    found.append(node)
+        return found, True
+
+    def resolve_name(module, symbol):
+        if symbol in module.by_name:
+            return module.by_name[symbol]
+        if rock_neo is not None and symbol in rock_neo.by_name:
+            return rock_neo.by_name[symbol]
+        return None
+
+    # function pointer tables: only the ones that hold at least one function
+    tables = {}
+    for index, (_, _, _, _, _, module_tables) in zip(indexes, results):
+        for label, (start, end, symbols) in sorted(module_tables.items(), key=lambda t: t[1][0]):
+            entries = [n for n in (resolve_name(index, s) for s in symbols) if n is not None]
+            if entries:
+                index.tables.append((start, end, label, entries))
+                tables[label] = [index.index, start, entries]
+
+    edges = set()
+    unresolved = 0
+    for index, (_, _, _, _, refs, _) in zip(indexes, results):
+        for caller_vram, fn_refs, addresses in refs:
+            caller = index.function_at(caller_vram)
+            for kind, target in fn_refs:
+                callees, window = resolve(index, target)
+                if not callees:
+                    unresolved += 1
+                for callee in callees:
+                    edges.add((caller, callee, kind.upper() if window else kind))
+            for address in addresses:
+                callees, window = resolve(index, address)
+                for callee in callees:
+                    edges.add((caller, callee, KIND_ADDR.upper() if window else KIND_ADDR))
+                # tables live in the calling module or in rock_neo
+                for owner in (index, rock_neo):
+                    table = owner.table_at(address) if owner is not None else None
+                    if table is not None:
+                        for callee in table[1]:
+                            edges.add((caller, callee, KIND_TABLE))
+                        break
+
+    data = {
+        "modules": module_names,
+        "nodes": nodes,
+        "edges": sorted(list(edge) for edge in edges),
+        "tables": tables,
+    }
+    return data, unresolved
+
+
+def print_neighbours(graph, name, callers):
+    found = graph.find(name)
+    if not found:
+        sys.exit(f"{name} is not in the graph")
+    for i in found:
+        print(graph.describe(i))
+        for other, kind in sorted(graph.callers[i] if callers else graph.callees[i]):
+            print(f"  {kind} {graph.describe(other)}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build the call graph of rock_neo and every overlay")
+    parser.add_argument("-o", dest="output", default=DEFAULT_OUTPUT)
+    parser.add_argument("-j", dest="jobs", type=int, default=multiprocessing.cpu_count())
+    parser.add_argument("--callers", default=None, help="print the callers of a function from the saved graph")
+    parser.add_argument("--callees", default=None, help="print the callees of a function from the saved graph")
+    args = parser.parse_args()
+
+    if args.callers or args.callees:
+        graph = load(args.output)
+        print_neighbours(graph, args.callers or args.callees, args.callers is not None)
+        return
+
+    data, unresolved = build(args.jobs)
+    os.makedirs(os.path.dirname(args.output) or ".", exist_ok=True)
+    with open(args.output, "w") as f:
+        json.dump(data, f, separators=(",", ":"))
+
+    graph = CallGraph(data)
+    shared = [i for i in range(len(graph.nodes))
+              if len({graph.nodes[src][0] for src, _ in graph.callers[i]}) > 1]
+    print(f"{len(graph.nodes)} functions in {len(graph.modules)} modules, {len(graph.edges)} edges, "
+          f"{len(data['tables'])} function tables, {unresolved} unresolved calls")
+    print(f"{sum(1 for c in graph.callers if not c)} functions without a static caller, "
+          f"{len(shared)} called from more than one module")
+    for i in sorted(range(len(graph.nodes)), key=lambda i: -len(graph.callers[i]))[:10]:
+        if graph.callers[i]:
+            print(f"  {len(graph.callers[i]):5} callers  {graph.describe(i)}")
+    print(f"wrote {args.output}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,257 @@
+#!/usr/bin/env python3
+
+# Disc layout optimizer, from the CD access traces of FEATURES=CD_TRACE
+#
+# A trace is the Cd_trace ring of src/rock_neo/feature/cd.c, found by its "CDTR" magic anywhere in the given
+# files: a RAM dump taken from an emulator, or the output of build/cdsim --trace. Every pair of files
+# read one after the other adds a seek from the end of the first to the start of the second, and the
+# layout is the order of the CDDATA/DAT files that minimizes the sum of those seeks over all traces:
+#   - files read together are chained greedily, heaviest transitions first (like code layout by call
+#     frequency), and the chain is put at the start of the directory
+#   - then single files are moved to the position that lowers the cost the most, until nothing moves
+# Files that aren't in any trace keep their order after the chain.
+#
+# Writes the mkpsxiso XML with the DAT directory reordered, and Cd_comb_pos_tbl for the new layout
+# (mkpsxiso packs the files in XML order from the first DAT sector). Rebuild the disc with the XML and
+# regenerate build/cd_comb_pos.inc with tools/cdpos.py from it.
+#
+# Usage: python3 tools/cdlayout.py trace.bin [ram.bin ...] [--xml mml1.us.xml] [-o build/mml1.us.layout.xml]
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+sys.path.append(os.path.dirname(os.path.realpath(__file__)))
+import cdpos
+
+TRACE_MAGIC = b"CDTR"
+TRACE_SIZE = 256
+TRACE_ENTRY = struct.Struct("<IHBBII")
+TRACE_READ = 0
+TRACE_DONE = 1
+
+SECTOR_SIZE = 0x800
+
+re_row = re.compile(r"\{\s*0x([0-9A-Fa-f]+),\s*0x([0-9A-Fa-f]+),\s*(\d+)\s*\},\s*//\s*(\w+)")
+re_file = re.compile(r'<file name="([^"]+)" source="([^"]+)"')
+
+
+def sectors(size):
+    return (size + SECTOR_SIZE - 1) // SECTOR_SIZE
+
+
+def read_traces(path):
+    """Returns every trace in a file, each a list of (frame, comb, event, lba, bytes) oldest first."""
+    with open(path, "rb") as f:
+        data = f.read()
+    traces = []
+    offset = data.find(TRACE_MAGIC)
+    while offset >= 0:
+        end = offset + 8 + TRACE_SIZE * TRACE_ENTRY.size
+        count = struct.unpack_from("<I", data, offset + 4)[0]
+        if end <= len(data) and count < 0x10000000:
+            entries = [TRACE_ENTRY.unpack_from(data, offset + 8 + i * TRACE_ENTRY.size)
+                       for i in range(min(count, TRACE_SIZE))]
+            if count > TRACE_SIZE:
+                # the ring wrapped, the oldest entry is the next one to be written
+                start = count % TRACE_SIZE
+                entries = entries[start:] + entries[:start]
+            traces.append([(e[0], e[1], e[2], e[4], e[5]) for e in entries])
+        offset = data.find(TRACE_MAGIC, offset + 4)
+    return traces
+
+
+def read_table(path):
+    """Returns {CD_COMB value: (name, lba, size, flags)} from a generated Cd_comb_pos_tbl."""
+    table = {}
+    value = 0
+    with open(path, "r") as f:
+        for line in f:
+            match = re_row.search(line)
+            if match:
+                table[value] = (match.group(4), int(match.group(1), 16), int(match.group(2), 16), int(match.group(3)))
+                value += 1
+    return table
+
+
+def dat_files(xml_path):
+    """Returns the lines of the XML and [(line index, file name, source)] of the DAT directory."""
+    with open(xml_path, "r") as f:
+        lines = f.readlines()
+    files = []
+    inside = False
+    for i, line in enumerate(lines):
+        if '<dir name="DAT"' in line:
+            inside = True
+        elif inside and "</dir>" in line:
+            break
+        elif inside:
+            match = re_file.search(line)
+            if match:
+                files.append((i, match.group(1), match.group(2)))
+    return lines, files
+
+
+def transitions(traces, names):
+    """Returns {(a, b): count} of consecutive reads, by file name, in both directions."""
+    weights = {}
+    for trace in traces:
+        previous = None
+        for _, comb, event, _, _ in trace:
+            if event != TRACE_READ or comb not in names:
+                continue
+            name = names[comb]
+            if previous is not None and previous != name:
+                key = (previous, name)
+                weights[key] = weights.get(key, 0) + 1
+            previous = name
+    return weights
+
+
+class Layout:
+    def __init__(self, order, sizes, start):
+        self.sizes = sizes
+        self.start = start
+        self.set(order)
+
+    def set(self, order):
+        self.order = list(order)
+        self.lba = {}
+        lba = self.start
+        for name in self.order:
+            self.lba[name] = lba
+            lba += sectors(self.sizes[name])
+
+    def cost(self, weights):
+        total = 0
+        for (a, b), count in weights.items():
+            end = self.lba[a] + sectors(self.sizes[a])
+            total += count * abs(self.lba[b] - end)
+        return total
+
+
+def chain(weights, names):
+    """Greedy chaining of the files in the traces, heaviest pair first."""
+    chains = {name: [name] for name in names}
+    pair = {}
+    for (a, b), count in weights.items():
+        key = tuple(sorted((a, b)))
+        pair[key] = pair.get(key, 0) + count
+    for (a, b), _ in sorted(pair.items(), key=lambda p: (-p[1], p[0])):
+        ca, cb = chains[a], chains[b]
+        if ca is cb:
+            continue
+        # only chain ends can be joined, turn the chains so that a and b meet
+        if ca[-1] != a:
+            if ca[0] != a:
+                continue
+            ca.reverse()
+        if cb[0] != b:
+            if cb[-1] != b:
+                continue
+            cb.reverse()
+        ca.extend(cb)
+        for name in cb:
+            chains[name] = ca
+    seen = set()
+    out = []
+    for name in names:
+        if id(chains[name]) not in seen:
+            seen.add(id(chains[name]))
+            out.extend(chains[name])
+    return out
+
+
+def improve(layout, weights, movable, max_passes):
+    """Moves single files of the chain to their best place in it while the cost goes down."""
+    best = layout.cost(weights)
+    for _ in range(max_passes):
+        moved = False
+        for name in movable:
+            current = layout.order
+            rest = [n for n in current if n != name]
+            best_order = current
+            for i in range(len(movable)):
+                candidate = rest[:i] + [name] + rest[i:]
+                layout.set(candidate)
+                cost = layout.cost(weights)
+                if cost < best:
+                    best, best_order = cost, candidate
+            layout.set(best_order)
+            moved |= best_order is not current
+        if not moved:
+            break
+    return best
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Reorder CDDATA/DAT from CD access traces")
+    parser.add_argument("traces", nargs="+", help="RAM dumps or build/cdsim --trace outputs")
+    parser.add_argument("--xml", default="mml1.us.xml")
+    parser.add_argument("--table", default="build/cd_comb_pos.inc", help="Cd_comb_pos_tbl of the current disc")
+    parser.add_argument("-o", dest="output", default="build/mml1.us.layout.xml")
+    parser.add_argument("--table-out", default="build/cd_comb_pos.layout.inc")
+    parser.add_argument("--passes", type=int, default=8, help="rounds of single file moves")
+    args = parser.parse_args()
+
+    traces = [t for path in args.traces for t in read_traces(path)]
+    if not traces:
+        sys.exit("no CD_TRACE log in " + ", ".join(args.traces))
+    table = read_table(args.table)
+    names = {value: row[0][:-4] + ".BIN" for value, row in table.items() if row[2] != 0}
+    lines, files = dat_files(args.xml)
+    if not files:
+        sys.exit(f"no DAT directory in {args.xml}")
+
+    # sizes from the files mkpsxiso will pack, the table for those not extracted
+    by_name = {row[0][:-4] + ".BIN": row for row in table.values() if row[2] != 0}
+    sizes = {}
+    for _, name, source in files:
+        if os.path.exists(source):
+            sizes[name] = os.path.getsize(source)
+        elif name in by_name:
+            sizes[name] = by_name[name][2]
+        else:
+            sys.exit(f"no size for {name}: {source} is missing and it isn't in {args.table}")
+    start = min(row[1] for row in by_name.values())
+
+    weights = transitions(traces, names)
+    weights = {k: v for k, v in weights.items() if k[0] in sizes and k[1] in sizes}
+    traced = [name for _, name, _ in files if any(name in k for k in weights)]
+    original = [name for _, name, _ in files]
+    layout = Layout(original, sizes, start)
+    before = layout.cost(weights)
+
+    chained = chain(weights, traced)
+    layout.set(chained + [n for n in original if n not in set(chained)])
+    after = improve(layout, weights, chained, args.passes)
+    if after > before:
+        # never worse than the retail order
+        layout.set(original)
+        after = before
+
+    reads = sum(1 for t in traces for e in t if e[2] == TRACE_READ)
+    print(f"{len(traces)} traces, {reads} reads, {len(traced)} files read, {len(weights)} transitions")
+    print(f"seek distance: {before} sectors in the retail order, {after} after ({after - before:+d})")
+
+    # the XML: same lines, the DAT file lines in the new order
+    slots = [i for i, _, _ in files]
+    line_of = {name: lines[i] for i, name, _ in files}
+    for slot, name in zip(slots, layout.order):
+        lines[slot] = line_of[name]
+    os.makedirs(os.path.dirname(args.output) or ".", exist_ok=True)
+    with open(args.output, "w") as f:
+        f.writelines(lines)
+
+    dat = {}
+    for name in layout.order:
+        row = by_name.get(name)
+        dat[name] = (name, layout.lba[name], sizes[name], False, row[3] if row else 0)
+    cdpos.write_table(args.table_out, args.output, dat, generator="tools/cdlayout.py")
+    print(f"wrote {args.output} and {args.table_out}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+
+# Writes Cd_comb_pos_tbl (build/cd_comb_pos.inc), the position and size of every CDDATA/DAT file
+# indexed by CD_COMB, read from the ISO9660 directory of a disc image.
+#
+# Files whose chunks are all plain data (type 0 with a load address, see docs/CHUNKS.md) are flagged
+# CD_COMB_PLAIN, the CD layer can stream those straight to their load addresses. So are the ones
+# rewritten with CHUNK_LZ chunks by tools/buildoverlay.py --compress, which only CD_LZ can load.
+#
+# Usage: python3 tools/cdpos.py disks/mml1.us.track1.bin build/cd_comb_pos.inc
+
+import argparse
+import os
+import re
+import struct
+
+SECTOR_SIZE = 0x800
+RAW_SECTOR_SIZE = 2352
+RAW_DATA_OFFSET = 24  # mode 2 form 1: 12 sync + 4 header + 8 subheader
+CD_H = "include/rock_neo/cd.h"
+
+CD_COMB_PLAIN = 1
+CHUNK_END = 0xFFFFFFFF
+CHUNK_LZ = 0x100  # type 0 payload compressed with tools/lz.py, the size at 0x10
+
+
+class DiscImage:
+    def __init__(self, path):
+        self.file = open(path, "rb")
+        # raw 2352 byte sectors (dumpsxiso, mkpsxiso .bin) or plain 2048 byte ones (.iso)
+        self.raw = self.has_sync()
+
+    def has_sync(self):
+        self.file.seek(0)
+        return self.file.read(12) == b"\x00" + b"\xFF" * 10 + b"\x00"
+
+    def read_sector(self, lba):
+        if self.raw:
+            self.file.seek(lba * RAW_SECTOR_SIZE + RAW_DATA_OFFSET)
+        else:
+            self.file.seek(lba * SECTOR_SIZE)
+        return self.file.read(SECTOR_SIZE)
+
+    def read_extent(self, lba, size):
+        data = b"".join(self.read_sector(lba + i) for i in range((size + SECTOR_SIZE - 1) // SECTOR_SIZE))
+        return data[:size]
+
+    def root(self):
+        pvd = self.read_sector(16)
+        if pvd[1:6] != b"CD001":
+            raise ValueError("no ISO9660 primary volume descriptor")
+        return parse_record(pvd[156:190])
+
+    def list_dir(self, record):
+        entries = []
+        data = self.read_extent(record[1], record[2])
+        pos = 0
+        while pos < len(data):
+            length = data[pos]
+            if length == 0:
+                # records don't cross sector boundaries
+                pos = (pos // SECTOR_SIZE + 1) * SECTOR_SIZE
+                continue
+            entry = parse_record(data[pos:pos + length])
+            if entry[0] not in ("\0", "\1"):
+                entries.append(entry)
+            pos += length
+        return entries
+
+    def find(self, path):
+        record = self.root()
+        for part in path.strip("/").split("/"):
+            for entry in self.list_dir(record):
+                if entry[0] == part:
+                    record = entry
+                    break
+            else:
+                raise FileNotFoundError(path)
+        return record
+
+
+def parse_record(data):
+    # (name, lba, size, is directory)
+    lba = struct.unpack_from("<I", data, 2)[0]
+    size = struct.unpack_from("<I", data, 10)[0]
+    flags = data[25]
+    name_length = data[32]
+    name = data[33:33 + name_length].decode("ascii", errors="replace").split(";")[0]
+    return name, lba, size, bool(flags & 2)
+
+
+re_enum = re.compile(r"typedef enum _CD_COMB \{(.*?)\} CD_COMB;", re.DOTALL)
+
+
+def read_cd_comb():
+    """Returns [(value, name)] of the CD_COMB enum."""
+    with open(CD_H, "r") as f:
+        body = re_enum.search(f.read()).group(1)
+    values = []
+    value = -1
+    for item in body.split(","):
+        item = re.sub(r"//.*", "", item).strip()
+        if not item:
+            continue
+        name, _, explicit = item.partition("=")
+        value = int(explicit.strip(), 0) if explicit else value + 1
+        values.append((value, name.strip()))
+    return values
+
+
+def is_plain(data):
+    offset = 0
+    while offset < len(data):
+        chunk_type, size, _, load_address = struct.unpack_from("<IIII", data, offset)
+        if chunk_type == CHUNK_END:
+            return True
+        if chunk_type not in (0, CHUNK_LZ) or load_address < 0x80010000 or offset + SECTOR_SIZE + size > len(data):
+            return False
+        offset += SECTOR_SIZE + ((size + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1))
+    return True
+
+
+def write_table(path, image_path, files, generator="tools/cdpos.py"):
+    enum = read_cd_comb()
+    lines = [f"// generated by {generator} from {image_path}, do not edit", "CD_COMB_POS Cd_comb_pos_tbl[] = {"]
+    by_value = dict(enum)
+    for value in range(enum[-1][0] + 1):
+        name = by_value.get(value)
+        entry = files.get(name[:-4] + ".BIN") if name else None
+        lba, size, flags = (entry[1], entry[2], entry[4]) if entry else (0, 0, 0)
+        lines.append(f"    {{ 0x{lba:06X}, 0x{size:06X}, {flags} }}, // {name or value}")
+    lines.append("};")
+    os.makedirs(os.path.dirname(path) or ".", exist_ok=True)
+    with open(path, "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+def read_dat_files(image_path):
+    """Returns {name: (name, lba, size, is directory, flags)}."""
+    image = DiscImage(image_path)
+    files = {}
+    for entry in image.list_dir(image.find("CDDATA/DAT")):
+        flags = CD_COMB_PLAIN if is_plain(image.read_extent(entry[1], entry[2])) else 0
+        files[entry[0]] = entry + (flags,)
+    return files
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate Cd_comb_pos_tbl from a disc image")
+    parser.add_argument("image")
+    parser.add_argument("output")
+    args = parser.parse_args()
+    write_table(args.output, args.image, read_dat_files(args.image))
+
+
+if __name__ == "__main__":
+    main()
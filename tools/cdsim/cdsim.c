@@ -0,0 +1,457 @@
+// Host CD simulator for the CD features of src/rock_neo/feature/cd.c
+//
+// cd.c is built for the host with the same FEATURES as the game and linked against the simulated drive
+// of drive.c, which reads the real disc image with a seek/rotation/transfer timing model. A scenario
+// queues reads frame by frame, the way the game would, and the main loop runs the drive events and
+// calls Cd_async_service() once per frame. The report gives the load time in frames and ms and the
+// seeks, so loader strategies (FEATURES, --serial) can be compared on the same scenario. Every raw read
+// and every CD_ZERO_COPY archive is checked against the image, and a scenario that doesn't finish
+// within --max-frames fails, which catches lost requests, and so does a game Cd_read_comb that a read
+// of cd.c interrupts, or the other way round. With CD_TRACE, --trace writes the access
+// trace for tools/cdlayout.py. --lz-bench runs the benchmark of lzbench.c instead of a scenario.
+// --bad-sector LBA[:N] makes the next N reads of a sector fail (1 by default), to follow the error
+// recovery of cd.c; a read it gives up is reported and not checked.
+//
+// Scenario lines: <frames after the previous line> <action> [FILE_BIN [priority [deadline]]]
+//   load FILE_BIN   Cd_read_comb_async without dest, the chunks go where their headers say
+//   raw FILE_BIN    Cd_read_comb_async of the raw file to a buffer
+//   hint FILE_BIN   Cd_prefetch_hint (CD_PREFETCH), a later sync of the file is served from RAM
+//   cancel FILE_BIN Cd_prefetch_cancel (CD_PREFETCH), drops the file from the prefetch buffer
+//   pin FILE_BIN    Cd_prefetch_pin (CD_RESIDENT), the same but kept until unpinned
+//   unpin FILE_BIN  Cd_prefetch_unpin (CD_RESIDENT)
+//   sync FILE_BIN   the game's own Cd_read_comb, waited on with Cd_read_sync2 every frame. When it is
+//                   served from RAM, its chunks are checked at their load addresses and in VRAM
+//   wait            waits until every read is done
+//
+// Usage: make cdsim FEATURES="CD_ASYNC ..." && build/cdsim tools/cdsim/scenarios/stage.txt
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cdsim.h"
+
+#define FRAME_US (1000000.0 / 59.94)
+#define MAX_FILES 512
+#define MAX_STEPS 256
+#define PREFETCH_BUDGET 0x40000
+
+typedef struct {
+    unsigned int delay;
+    char action[8];
+    int comb;
+    unsigned int priority;
+    unsigned int deadline;
+    unsigned int issued;
+    unsigned int done;
+    void* dest;
+} step;
+
+static char* file_names[MAX_FILES];
+static int file_count;
+static step steps[MAX_STEPS];
+static int step_count;
+static int serial;
+static int quiet;
+static unsigned int frame;
+static int pending;
+static int failures;
+static int given_up;
+
+static const char* comb_name(int comb) {
+    return comb >= 0 && comb < file_count && file_names[comb] != NULL ? file_names[comb] : "?";
+}
+
+// names come from the comments of the generated table: `{ 0x00001C, 0x01A000, 1 }, // ST04_BIN`
+static int load_names(const char* path) {
+    char line[256];
+    char* name;
+    FILE* f = fopen(path, "r");
+
+    if (f == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL && file_count < MAX_FILES) {
+        if (strchr(line, '{') == NULL || (name = strstr(line, "// ")) == NULL) {
+            continue;
+        }
+        name += 3;
+        name[strcspn(name, "\r\n")] = 0;
+        file_names[file_count++] = strdup(name);
+    }
+    fclose(f);
+    return 0;
+}
+
+static int find_comb(const char* name) {
+    int i;
+
+    for (i = 0; i < file_count; i++) {
+        if (strcmp(file_names[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int load_scenario(const char* path) {
+    char line[256];
+    char name[64];
+    step* s;
+    int fields;
+    FILE* f = fopen(path, "r");
+
+    if (f == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[strspn(line, " \t")] == '#' || line[strspn(line, " \t\r\n")] == 0) {
+            continue;
+        }
+        if (step_count == MAX_STEPS) {
+            fprintf(stderr, "cdsim: more than %d steps in %s\n", MAX_STEPS, path);
+            return -1;
+        }
+        s = &steps[step_count++];
+        memset(s, 0, sizeof(*s));
+        s->comb = -1;
+        fields = sscanf(line, "%u %7s %63s %u %u", &s->delay, s->action, name, &s->priority, &s->deadline);
+        if (fields < 2) {
+            fprintf(stderr, "cdsim: bad line in %s: %s", path, line);
+            return -1;
+        }
+        if (strcmp(s->action, "wait") != 0) {
+            s->comb = fields >= 3 ? find_comb(name) : -1;
+            if (s->comb < 0) {
+                fprintf(stderr, "cdsim: unknown file in %s: %s", path, line);
+                return -1;
+            }
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+static void check_raw(step* s) {
+    cdsim_pos* pos = &Cd_comb_pos_tbl[s->comb];
+    unsigned char sector[0x800];
+    unsigned int offset;
+    unsigned int n;
+
+    for (offset = 0; offset < pos->size; offset += n) {
+        n = pos->size - offset < 0x800 ? pos->size - offset : 0x800;
+        cdsim_read_sector(pos->lba + offset / 0x800, sector);
+        if (memcmp((unsigned char*)s->dest + offset, sector, n) != 0) {
+            printf("  MISMATCH %s at 0x%X\n", comb_name(s->comb), offset);
+            failures++;
+            return;
+        }
+    }
+}
+
+#if defined(CD_ZERO_COPY) || defined(CD_PREFETCH)
+// the chunks of an archive must be at their load addresses, and its textures in VRAM
+static void check_archive(step* s) {
+    cdsim_pos* pos = &Cd_comb_pos_tbl[s->comb];
+    unsigned char header[0x800];
+    unsigned char sector[0x800];
+    unsigned int lba = pos->lba;
+    unsigned int size;
+    unsigned int address;
+    unsigned int offset;
+    unsigned int n;
+    unsigned int* rect;
+
+    while (lba < pos->lba + (pos->size + 0x7FF) / 0x800) {
+        cdsim_read_sector(lba++, header);
+        if (*(unsigned int*)header == 0xFFFFFFFF) {
+            return;
+        }
+        size = ((unsigned int*)header)[1];
+        address = ((unsigned int*)header)[3];
+        if (CDSIM_CHUNK_TEXTURE(*(unsigned int*)header)) {
+            // x, y, w, h at 0x1C, the rows follow each other in the sectors
+            rect = (unsigned int*)(header + 0x1C);
+            size = rect[2] * rect[3] * 2;
+            for (offset = 0; offset < size; offset += 2) {
+                if (offset % 0x800 == 0) {
+                    cdsim_read_sector(lba++, sector);
+                }
+                if (cdsim_vram[rect[1] + offset / 2 / rect[2]][rect[0] + offset / 2 % rect[2]] !=
+                    *(unsigned short*)(sector + offset % 0x800)) {
+                    printf("  MISMATCH %s texture at %u,%u + 0x%X\n", comb_name(s->comb), rect[0], rect[1], offset);
+                    failures++;
+                    return;
+                }
+            }
+            continue;
+        }
+#ifdef CD_LZ
+        if (*(unsigned int*)header == CDSIM_CHUNK_LZ) {
+            // decoded again from the image, the size once decoded is at 0x10
+            unsigned char* plain = malloc(((unsigned int*)header)[4] + 0x10000);
+            unsigned char* end = plain;
+            int ok;
+
+            for (offset = 0; offset < size; offset += 0x800) {
+                cdsim_read_sector(lba++, sector);
+                end = Cd_lz_decode(end, sector);
+            }
+            ok = end - plain == ((unsigned int*)header)[4] &&
+                 memcmp(cdsim_map((void*)(uintptr_t)address), plain, end - plain) == 0;
+            free(plain);
+            if (!ok) {
+                printf("  MISMATCH %s compressed chunk at 0x%08X\n", comb_name(s->comb), address);
+                failures++;
+                return;
+            }
+            continue;
+        }
+#endif
+        for (offset = 0; offset < size; offset += n, lba++) {
+            n = size - offset < 0x800 ? size - offset : 0x800;
+            cdsim_read_sector(lba, sector);
+            if (memcmp(cdsim_map((void*)(uintptr_t)(address + offset)), sector, n) != 0) {
+                printf("  MISMATCH %s chunk at 0x%08X + 0x%X\n", comb_name(s->comb), address, offset);
+                failures++;
+                return;
+            }
+        }
+    }
+}
+#endif
+
+static void run_frame(void);
+
+static void done(int comb, void* dest, void* user) {
+    step* s = user;
+
+    s->done = frame;
+    pending--;
+    if (!quiet) {
+        printf("%6u %9.1f  done   %-14s %u frames\n", frame, cdsim_now_us / 1000.0, comb_name(comb),
+               frame - s->issued);
+    }
+    if (Cd_async_failed) {
+        printf("  GIVEN UP %s\n", comb_name(comb));
+        given_up++;
+    } else if (s->dest != NULL) {
+        check_raw(s);
+    }
+#ifdef CD_ZERO_COPY
+    else if (Cd_comb_pos_tbl[comb].flags & CDSIM_PLAIN) {
+        check_archive(s);
+    }
+#endif
+}
+
+static int issue(step* s) {
+    int ok = 0;
+
+    s->issued = frame;
+    if (!quiet) {
+        printf("%6u %9.1f  %-6s %s\n", frame, cdsim_now_us / 1000.0, s->action, comb_name(s->comb));
+    }
+    if (strcmp(s->action, "load") == 0 || strcmp(s->action, "raw") == 0) {
+        if (s->action[0] == 'r') {
+            s->dest = calloc(1, Cd_comb_pos_tbl[s->comb].size + 4);
+        }
+        ok = Cd_read_comb_async2(s->comb, s->dest, done, s, s->priority, s->deadline);
+        if (ok == 0) {
+            pending++;
+        }
+    } else if (strcmp(s->action, "sync") == 0) {
+#ifdef CD_PREFETCH
+        unsigned int scattered = Cd_prefetch_scattered;
+#endif
+
+        Cd_read_comb(s->comb);
+        // the game waits on Cd_read_sync2() frame after frame
+        while (Cd_read_sync2()) {
+            run_frame();
+        }
+        s->done = frame;
+        if (!quiet) {
+            printf("%6u %9.1f  done   %-14s %u frames\n", frame, cdsim_now_us / 1000.0, comb_name(s->comb),
+                   frame - s->issued);
+        }
+#ifdef CD_PREFETCH
+        if (Cd_prefetch_scattered != scattered) {
+            check_archive(s);
+        }
+#endif
+    } else if (strcmp(s->action, "hint") == 0) {
+#ifdef CD_PREFETCH
+        // a hint that can't be kept is dropped, as in the game
+        Cd_prefetch_hint(s->comb);
+#endif
+    } else if (strcmp(s->action, "cancel") == 0) {
+#ifdef CD_PREFETCH
+        Cd_prefetch_cancel(s->comb);
+#endif
+    } else if (strcmp(s->action, "pin") == 0) {
+#ifdef CD_RESIDENT
+        if (Cd_prefetch_pin(s->comb) != 0) {
+            printf("  NOT KEPT %s\n", comb_name(s->comb));
+        }
+#endif
+    } else if (strcmp(s->action, "unpin") == 0) {
+#ifdef CD_RESIDENT
+        Cd_prefetch_unpin(s->comb);
+#endif
+    }
+    return ok;
+}
+
+int VSync(int mode) {
+    return frame;
+}
+
+static void run_frame(void) {
+    double end = (frame + 1) * FRAME_US;
+
+    while (cdsim_next_event() >= 0.0 && cdsim_next_event() < end) {
+        cdsim_step();
+    }
+    cdsim_now_us = end;
+    frame++;
+    Cd_async_service();
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: cdsim [--image disc.bin] [--table build/cd_comb_pos.inc] [--serial] [--quiet]\n"
+                    "             [--seek-base-ms N] [--seek-full-ms N] [--rotation-ms N] [--error-rate P]\n"
+                    "             [--seed N] [--max-frames N] [--trace out.bin] [--bad-sector LBA[:N]]\n"
+                    "             scenario.txt\n"
+                    "       cdsim --lz-bench file.lz file.bin\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    static const struct option options[] = {
+        { "image", required_argument, 0, 'i' },        { "table", required_argument, 0, 't' },
+        { "serial", no_argument, 0, 's' },             { "quiet", no_argument, 0, 'q' },
+        { "seek-base-ms", required_argument, 0, 'b' }, { "seek-full-ms", required_argument, 0, 'f' },
+        { "rotation-ms", required_argument, 0, 'r' },  { "error-rate", required_argument, 0, 'e' },
+        { "seed", required_argument, 0, 'S' },         { "max-frames", required_argument, 0, 'm' },
+        { "trace", required_argument, 0, 'T' },        { "lz-bench", required_argument, 0, 'z' },
+        { "bad-sector", required_argument, 0, 'B' },   { 0, 0, 0, 0 },
+    };
+    const char* image = "disks/mml1.us.track1.bin";
+    const char* table = "build/cd_comb_pos.inc";
+    const char* trace = NULL;
+    const char* lz_bench = NULL;
+    unsigned int max_frames = 60 * 60;
+    unsigned int wait = 0;
+    int next = 0;
+    char* count;
+    int c;
+
+    while ((c = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (c) {
+        case 'i': image = optarg; break;
+        case 't': table = optarg; break;
+        case 's': serial = 1; break;
+        case 'q': quiet = 1; break;
+        case 'b': cdsim_time_model.seek_base_ms = atof(optarg); break;
+        case 'f': cdsim_time_model.seek_full_ms = atof(optarg); break;
+        case 'r': cdsim_time_model.rotation_ms = atof(optarg); break;
+        case 'e': cdsim_time_model.error_rate = atof(optarg); break;
+        case 'S': cdsim_time_model.seed = strtoul(optarg, NULL, 0); break;
+        case 'm': max_frames = strtoul(optarg, NULL, 0); break;
+        case 'T': trace = optarg; break;
+        case 'z': lz_bench = optarg; break;
+        case 'B':
+            count = strchr(optarg, ':');
+            if (cdsim_bad_sector(strtoul(optarg, NULL, 0), count != NULL ? strtoul(count + 1, NULL, 0) : 1) != 0) {
+                usage();
+            }
+            break;
+        default: usage();
+        }
+    }
+    if (optind + 1 != argc) {
+        usage();
+    }
+    if (lz_bench != NULL) {
+        return cdsim_lz_bench(lz_bench, argv[optind]);
+    }
+    if (cdsim_open_image(image) != 0 || load_names(table) != 0 || load_scenario(argv[optind]) != 0) {
+        fprintf(stderr, "cdsim: can't read %s, %s or %s\n", image, table, argv[optind]);
+        return 2;
+    }
+#ifdef CD_PREFETCH
+    Cd_prefetch_init(calloc(1, PREFETCH_BUDGET), PREFETCH_BUDGET);
+#endif
+
+    while (next < step_count || pending != 0) {
+        if (frame >= max_frames) {
+            printf("TIMEOUT after %u frames, %d reads still pending\n", frame, pending);
+            return 1;
+        }
+        // --serial waits for every read before the next one, like the game's Cd_read_comb loops
+        while (next < step_count && wait == 0 && !(serial && pending != 0)) {
+            if (strcmp(steps[next].action, "wait") == 0) {
+                if (pending != 0) {
+                    break;
+                }
+                next++;
+                continue;
+            }
+            if (steps[next].delay > 0) {
+                wait = steps[next].delay;
+                steps[next].delay = 0;
+                break;
+            }
+            if (issue(&steps[next]) != 0) {
+                // queue full, try again next frame
+                break;
+            }
+            next++;
+        }
+        if (wait != 0) {
+            wait--;
+        }
+        run_frame();
+    }
+
+    printf("%u frames (%.1f ms), %u sectors, %u seeks over %u sectors (%.1f ms seeking), %u errors\n", frame,
+           cdsim_now_us / 1000.0, cdsim_counters.sectors, cdsim_counters.seeks, cdsim_counters.seek_distance,
+           cdsim_counters.seek_ms, cdsim_counters.errors);
+    printf("cd.c: %u seeks over %u sectors, %u Cd_read_comb, %u cache flushes\n", Cd_seek_count,
+           Cd_seek_distance, cdsim_counters.retail_reads, cdsim_counters.flushes);
+#ifdef CD_PREFETCH
+    printf("cd.c: %u Cd_read_comb served from RAM\n", Cd_prefetch_scattered);
+#endif
+    printf("cd.c errors: %u read, %u seek, %u not ready, %u overruns, %u retries, %u slowdowns, %u given up\n",
+           Cd_error_counts.read, Cd_error_counts.seek, Cd_error_counts.not_ready, Cd_error_counts.overrun,
+           Cd_error_counts.retries, Cd_error_counts.slowdowns, Cd_error_counts.failures);
+    if (trace != NULL) {
+#ifdef CD_TRACE
+        FILE* f = fopen(trace, "wb");
+
+        if (f == NULL || fwrite(Cd_trace, 1, CDSIM_TRACE_BYTES, f) != CDSIM_TRACE_BYTES) {
+            fprintf(stderr, "cdsim: can't write %s\n", trace);
+            return 2;
+        }
+        fclose(f);
+#else
+        fprintf(stderr, "cdsim: --trace needs FEATURES=CD_TRACE\n");
+        return 2;
+#endif
+    }
+    if (given_up != 0) {
+        printf("%d reads given up\n", given_up);
+    }
+    if (cdsim_counters.retail_cut != 0) {
+        printf("%u Cd_read_comb reads cut short\n", cdsim_counters.retail_cut);
+    }
+    if (cdsim_counters.raw_cut != 0) {
+        printf("%u reads of cd.c cut short by Cd_read_comb\n", cdsim_counters.raw_cut);
+    }
+    if (failures != 0) {
+        printf("%d reads don't match the disc image\n", failures);
+    }
+    return failures != 0 || cdsim_counters.retail_cut != 0 || cdsim_counters.raw_cut != 0;
+}
@@ -0,0 +1,116 @@
+#ifndef CDSIM_H
+#define CDSIM_H
+
+// Host side of the CD simulator, see cdsim.c. src/rock_neo/feature/cd.c is compiled in its own
+// translation unit against the game headers, everything here only uses the host C library and talks
+// to it through the symbols below.
+
+#include <stdint.h>
+
+// the feature implications of include/rock_neo.h that matter here (CD_ASYNC is always on)
+#if defined(SUB_SCREEN_RESIDENT) && !defined(CD_RESIDENT)
+#define CD_RESIDENT
+#endif
+#if defined(CD_RESIDENT) && !defined(CD_PREFETCH)
+#define CD_PREFETCH
+#endif
+#if defined(CD_LZ) && !defined(CD_ZERO_COPY)
+#define CD_ZERO_COPY
+#endif
+
+typedef void (*cdsim_ready_cb)(unsigned char intr, unsigned char* result);
+typedef void (*cdsim_async_cb)(int comb, void* dest, void* user);
+
+typedef struct {
+    unsigned int lba;
+    unsigned int size;
+    unsigned int flags;
+} cdsim_pos;
+
+#define CDSIM_PLAIN 1 // CD_COMB_PLAIN
+#define CDSIM_CHUNK_LZ 0x100 // CD_CHUNK_LZ
+#define CDSIM_CHUNK_TEXTURE(type) ((type) == 1 || (type) == 9 || (type) == 10)
+
+// cd.c
+extern cdsim_pos Cd_comb_pos_tbl[];
+extern unsigned int Cd_seek_count;
+extern unsigned int Cd_seek_distance;
+int Cd_read_comb_async(int comb, void* dest, cdsim_async_cb callback, void* user);
+int Cd_read_comb_async2(int comb, void* dest, cdsim_async_cb callback, void* user, unsigned char priority,
+                        unsigned short deadline);
+void Cd_async_service(void);
+int Cd_async_busy(void);
+#ifdef CD_PREFETCH
+void Cd_prefetch_init(void* buffer, unsigned int budget);
+int Cd_prefetch_hint(int comb);
+void Cd_prefetch_cancel(int comb);
+extern unsigned int Cd_prefetch_scattered;
+#endif
+#ifdef CD_RESIDENT
+int Cd_prefetch_pin(int comb);
+void Cd_prefetch_unpin(int comb);
+#endif
+#ifdef CD_TRACE
+extern unsigned char Cd_trace[];
+#define CDSIM_TRACE_BYTES (8 + 256 * 16) // CD_TRACE_LOG
+#endif
+#ifdef CD_LZ
+unsigned char* Cd_lz_decode(unsigned char* out, unsigned char* in);
+#endif
+typedef struct {
+    unsigned int not_ready;
+    unsigned int seek;
+    unsigned int read;
+    unsigned int overrun;
+    unsigned int retries;
+    unsigned int slowdowns;
+    unsigned int failures;
+} cdsim_errors; // CD_ERROR_COUNTS
+extern cdsim_errors Cd_error_counts;
+extern unsigned char Cd_async_failed;
+int Cd_read_comb(int comb);
+int Cd_read_sync2(void);
+
+// lzbench.c
+int cdsim_lz_bench(const char* packed_path, const char* plain_path);
+
+// drive.c
+typedef struct {
+    double seek_base_ms;    // any seek, head settle included
+    double seek_full_ms;    // added for a seek across the whole disc, scaled by the square root of the distance
+    double rotation_ms;     // one revolution at single speed, a seek waits half of it
+    double error_rate;      // chance of a CdlDiskError per sector
+    unsigned int seed;
+} cdsim_timing;
+
+typedef struct {
+    unsigned int sectors;   // delivered to the ready callback
+    unsigned int seeks;
+    unsigned int seek_distance;
+    double seek_ms;
+    unsigned int errors;
+    unsigned int retail_reads; // Cd_read_comb, simulated as a blind read
+    unsigned int retail_cut;   // retail reads a command of cd.c interrupted
+    unsigned int raw_cut;      // reads of cd.c a Cd_read_comb interrupted
+    unsigned int load_images;
+    unsigned int load_image_bytes;
+    unsigned int flushes;
+} cdsim_stats;
+
+extern cdsim_timing cdsim_time_model;
+extern cdsim_stats cdsim_counters;
+extern double cdsim_now_us;
+// what LoadImage wrote, 1024x512 pixels
+extern unsigned short cdsim_vram[512][1024];
+
+int cdsim_open_image(const char* path);
+unsigned int cdsim_image_sectors(void);
+void cdsim_read_sector(unsigned int lba, unsigned char* out);
+// the next count reads of the sector fail
+int cdsim_bad_sector(unsigned int lba, unsigned int count);
+void* cdsim_map(void* p);
+// time of the next drive event, or a negative value when the drive has nothing scheduled
+double cdsim_next_event(void);
+void cdsim_step(void);
+
+#endif
@@ -0,0 +1,387 @@
+// Simulated CD drive: libcd calls, the retail loader entry points, and the RAM at 0x80000000
+//
+// The drive is a small event machine on a virtual clock. Setloc+ReadN seeks and then delivers one
+// sector per sector period to the ready callback, until Pause. SeekL only moves the head. A seek costs
+// seek_base_ms + seek_full_ms * sqrt(distance / disc size) + half a revolution, and reading on from
+// where the head is costs nothing. Cd_read_comb is still asm in the game, so here it is a blind read:
+// it keeps the drive busy for the seek and the transfer of the whole file and delivers nothing. A
+// command that moves the head during a blind read is counted in retail_cut, and a Cd_read_comb over a
+// read of cd.c in raw_cut, both fail the run.
+//
+// The simulator is linked with the hooks of the game as --wrap flags (HOST_HOOKS in the Makefile), so
+// the functions here are the "real" ones the features hook. The RAM is mapped at 0x80000000 of the
+// host, so that what cd.c writes through a load address (the CD_LZ decoder) lands in it, KSEG1
+// addresses go through cdsim_map.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "cdsim.h"
+
+#define SECTOR_SIZE 0x800
+#define RAW_SECTOR_SIZE 2352
+#define RAW_DATA_OFFSET 24
+
+#define CdlSetloc 0x02
+#define CdlReadN 0x06
+#define CdlPause 0x09
+#define CdlSetmode 0x0E
+#define CdlSeekL 0x15
+#define CdlDataReady 0x01
+#define CdlDiskError 0x05
+#define CdlModeSpeed 0x80
+#define CdlStatError 0x01
+
+#define MAX_BAD_SECTORS 16
+
+#define RAM_BASE 0x80000000u
+#define RAM_SIZE 0x200000u
+
+int CdPosToInt(unsigned char* p);
+
+enum { DRIVE_IDLE, DRIVE_SEEK, DRIVE_SEEK_READ, DRIVE_READ, DRIVE_BLIND };
+
+cdsim_timing cdsim_time_model = { 20.0, 250.0, 150.0, 0.0, 1 };
+cdsim_stats cdsim_counters;
+double cdsim_now_us;
+unsigned short cdsim_vram[512][1024];
+
+static FILE* image;
+static int image_raw;
+static unsigned int image_size;
+
+static unsigned char* ram;
+
+static struct {
+    unsigned int lba;
+    unsigned int left; // reads that still fail
+} bad_sectors[MAX_BAD_SECTORS];
+static int bad_sector_count;
+
+static struct {
+    int state;
+    unsigned int head;   // next sector under the head
+    unsigned int target; // Setloc
+    int speed;
+    double next_us;
+    unsigned char sector[SECTOR_SIZE];
+    unsigned int sector_pos;
+    cdsim_ready_cb ready;
+    cdsim_ready_cb sync;
+} drive = { DRIVE_IDLE, 0, 0, 1, -1.0 };
+
+int cdsim_open_image(const char* path) {
+    unsigned char sync[12];
+    static const unsigned char pattern[12] = { 0, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0 };
+    long size;
+
+    ram = mmap((void*)(uintptr_t)RAM_BASE, RAM_SIZE, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (ram != (void*)(uintptr_t)RAM_BASE) {
+        fprintf(stderr, "cdsim: can't map the RAM at 0x%08X\n", RAM_BASE);
+        return -1;
+    }
+    image = fopen(path, "rb");
+    if (image == NULL) {
+        return -1;
+    }
+    image_raw = fread(sync, 1, sizeof(sync), image) == sizeof(sync) && memcmp(sync, pattern, sizeof(sync)) == 0;
+    fseek(image, 0, SEEK_END);
+    size = ftell(image);
+    image_size = size / (image_raw ? RAW_SECTOR_SIZE : SECTOR_SIZE);
+    srand(cdsim_time_model.seed);
+    return 0;
+}
+
+unsigned int cdsim_image_sectors(void) {
+    return image_size;
+}
+
+int cdsim_bad_sector(unsigned int lba, unsigned int count) {
+    if (bad_sector_count == MAX_BAD_SECTORS) {
+        return -1;
+    }
+    bad_sectors[bad_sector_count].lba = lba;
+    bad_sectors[bad_sector_count].left = count;
+    bad_sector_count++;
+    return 0;
+}
+
+static int read_fails(unsigned int lba) {
+    int i;
+
+    for (i = 0; i < bad_sector_count; i++) {
+        if (bad_sectors[i].lba == lba && bad_sectors[i].left != 0) {
+            bad_sectors[i].left--;
+            return 1;
+        }
+    }
+    return cdsim_time_model.error_rate > 0.0 && rand() < cdsim_time_model.error_rate * RAND_MAX;
+}
+
+void cdsim_read_sector(unsigned int lba, unsigned char* out) {
+    memset(out, 0, SECTOR_SIZE);
+    if (lba >= image_size) {
+        return;
+    }
+    fseek(image, image_raw ? (long)lba * RAW_SECTOR_SIZE + RAW_DATA_OFFSET : (long)lba * SECTOR_SIZE, SEEK_SET);
+    if (fread(out, 1, SECTOR_SIZE, image) != SECTOR_SIZE) {
+        memset(out, 0, SECTOR_SIZE);
+    }
+}
+
+// game addresses (KSEG0 and KSEG1) point into the simulated RAM, host pointers are left alone
+void* cdsim_map(void* p) {
+    uintptr_t address = (uintptr_t)p;
+
+    if (address >= RAM_BASE && address < RAM_BASE + RAM_SIZE) {
+        return ram + (address - RAM_BASE);
+    }
+    if (address >= 0xA0000000u && address < 0xA0000000u + RAM_SIZE) {
+        return ram + (address - 0xA0000000u);
+    }
+    return p;
+}
+
+static double sector_us(void) {
+    return 1000000.0 / (75.0 * drive.speed);
+}
+
+static double seek_us(unsigned int from, unsigned int to) {
+    unsigned int distance = from > to ? from - to : to - from;
+    double ms;
+
+    if (distance == 0) {
+        return 0.0;
+    }
+    ms = cdsim_time_model.seek_base_ms +
+         cdsim_time_model.seek_full_ms * sqrt((double)distance / (image_size ? image_size : 1)) +
+         cdsim_time_model.rotation_ms / drive.speed / 2.0;
+    cdsim_counters.seeks++;
+    cdsim_counters.seek_distance += distance;
+    cdsim_counters.seek_ms += ms;
+    return ms * 1000.0;
+}
+
+double cdsim_next_event(void) {
+    return drive.state == DRIVE_IDLE ? -1.0 : drive.next_us;
+}
+
+void cdsim_step(void) {
+    unsigned char result[8] = { 0 };
+
+    cdsim_now_us = drive.next_us;
+    switch (drive.state) {
+    case DRIVE_SEEK:
+    case DRIVE_BLIND:
+        drive.state = DRIVE_IDLE;
+        break;
+    case DRIVE_SEEK_READ:
+        drive.state = DRIVE_READ;
+        drive.next_us += sector_us();
+        break;
+    case DRIVE_READ:
+        drive.next_us += sector_us();
+        if (read_fails(drive.head)) {
+            // the head stays, the sector comes round again if the game reads on
+            cdsim_counters.errors++;
+            result[0] = CdlStatError;
+            if (drive.ready != NULL) {
+                drive.ready(CdlDiskError, result);
+            }
+            break;
+        }
+        cdsim_read_sector(drive.head++, drive.sector);
+        drive.sector_pos = 0;
+        cdsim_counters.sectors++;
+        if (drive.ready != NULL) {
+            drive.ready(CdlDataReady, result);
+        }
+        break;
+    }
+}
+
+static void start_seek(int state) {
+    double us = seek_us(drive.head, drive.target);
+
+    if (us == 0.0 && drive.state != DRIVE_READ) {
+        // stopped on the right track, the sector still has to come round
+        us = cdsim_time_model.rotation_ms / drive.speed / 2.0 * 1000.0;
+    }
+    drive.state = state;
+    drive.next_us = cdsim_now_us + us;
+    drive.head = drive.target;
+}
+
+int CdControl(unsigned char com, unsigned char* param, unsigned char* result) {
+    if (drive.state == DRIVE_BLIND && (com == CdlReadN || com == CdlSeekL || com == CdlPause)) {
+        // the game's loader still owns the drive, on the console its file would come in short
+        fprintf(stderr, "cdsim: CdControl 0x%02X at %.1f ms cuts a Cd_read_comb read short\n", com,
+                cdsim_now_us / 1000.0);
+        cdsim_counters.retail_cut++;
+    }
+    switch (com) {
+    case CdlSetloc:
+        drive.target = CdPosToInt(param);
+        break;
+    case CdlSetmode:
+        drive.speed = param[0] & CdlModeSpeed ? 2 : 1;
+        break;
+    case CdlReadN:
+        if (drive.state == DRIVE_READ && drive.head == drive.target) {
+            break;
+        }
+        start_seek(DRIVE_SEEK_READ);
+        break;
+    case CdlSeekL:
+        start_seek(DRIVE_SEEK);
+        break;
+    case CdlPause:
+        if (drive.state == DRIVE_READ || drive.state == DRIVE_SEEK_READ) {
+            drive.state = DRIVE_IDLE;
+        }
+        break;
+    }
+    return 1;
+}
+
+int CdControlB(unsigned char com, unsigned char* param, unsigned char* result) {
+    return CdControl(com, param, result);
+}
+
+int CdGetSector(void* madr, int size) {
+    unsigned int bytes = size * 4;
+
+    if (drive.sector_pos + bytes > SECTOR_SIZE) {
+        fprintf(stderr, "cdsim: CdGetSector past the end of the sector (%u + %u)\n", drive.sector_pos, bytes);
+        abort();
+    }
+    memcpy(cdsim_map(madr), drive.sector + drive.sector_pos, bytes);
+    drive.sector_pos += bytes;
+    return 1;
+}
+
+static unsigned char to_bcd(unsigned int n) {
+    return ((n / 10) << 4) | (n % 10);
+}
+
+static unsigned int from_bcd(unsigned char n) {
+    return (n >> 4) * 10 + (n & 0xF);
+}
+
+void* CdIntToPos(int i, unsigned char* p) {
+    i += 150;
+    p[0] = to_bcd(i / 4500);
+    p[1] = to_bcd(i / 75 % 60);
+    p[2] = to_bcd(i % 75);
+    p[3] = 0;
+    return p;
+}
+
+int CdPosToInt(unsigned char* p) {
+    return (from_bcd(p[0]) * 60 + from_bcd(p[1])) * 75 + from_bcd(p[2]) - 150;
+}
+
+cdsim_ready_cb CdReadyCallback(cdsim_ready_cb func) {
+    cdsim_ready_cb old = drive.ready;
+
+    drive.ready = func;
+    return old;
+}
+
+cdsim_ready_cb CdSyncCallback(cdsim_ready_cb func) {
+    cdsim_ready_cb old = drive.sync;
+
+    drive.sync = func;
+    return old;
+}
+
+int CdInit() {
+    return 1;
+}
+
+int CdReset(int mode) {
+    return 1;
+}
+
+// the retail loader
+
+int Cd_read_comb(int comb) {
+    cdsim_pos* pos = &Cd_comb_pos_tbl[comb];
+
+    cdsim_counters.retail_reads++;
+    if (drive.state == DRIVE_SEEK_READ || drive.state == DRIVE_READ) {
+        // only cd.c reads sector by sector, it would wait for the rest of its file forever
+        fprintf(stderr, "cdsim: Cd_read_comb at %.1f ms cuts a read of cd.c short\n", cdsim_now_us / 1000.0);
+        cdsim_counters.raw_cut++;
+    }
+    drive.target = pos->lba;
+    drive.speed = 2;
+    start_seek(DRIVE_BLIND);
+    drive.next_us += (pos->size + SECTOR_SIZE - 1) / SECTOR_SIZE * sector_us();
+    drive.head += (pos->size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    cdsim_counters.sectors += (pos->size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    return 0;
+}
+
+int Cd_read_sync2(void) {
+    return drive.state == DRIVE_BLIND;
+}
+
+// the rest of the PSX library the CD features link against
+
+void* cdsim_memcpy(unsigned char* dst, unsigned char* src, int n) {
+    return memcpy(cdsim_map(dst), cdsim_map(src), n);
+}
+
+void FlushCache(void) {
+    cdsim_counters.flushes++;
+}
+
+int DrawSync(int mode) {
+    return 0;
+}
+
+int LoadImage(void* rect, unsigned long* p) {
+    short* r = rect;
+    unsigned short* src = cdsim_map(p);
+    int y;
+
+    cdsim_counters.load_images++;
+    cdsim_counters.load_image_bytes += r[2] * r[3] * 2;
+    for (y = 0; y < r[3]; y++) {
+        memcpy(&cdsim_vram[r[1] + y][r[0]], src + y * r[2], r[2] * 2);
+    }
+    return 0;
+}
+
+void DrawOTag(unsigned long* p) {
+}
+
+int StoreImage(void* rect, unsigned long* p) {
+    return 0;
+}
+
+int MoveImage(void* rect, int x, int y) {
+    return 0;
+}
+
+int ClearImage(void* rect, unsigned char r, unsigned char g, unsigned char b) {
+    short* c = rect;
+    int x;
+    int y;
+
+    for (y = 0; y < c[3]; y++) {
+        for (x = 0; x < c[2]; x++) {
+            cdsim_vram[c[1] + y][c[0] + x] = (b >> 3) << 10 | (g >> 3) << 5 | r >> 3;
+        }
+    }
+    return 0;
+}
+
+void* PutDrawEnv(void* env) {
+    return env;
+}
@@ -0,0 +1,89 @@
+// Throughput of Cd_lz_decode, the CD_LZ decoder of src/rock_neo/feature/cd.c, on the host
+//
+// The payload of tools/lz.py pack is decoded sector by sector, the way Cd_raw_poll does it, over and
+// over for about a second, and the output is checked against the original file. Host numbers only
+// compare codec changes with each other, not with the console.
+//
+// Usage: make cdsim FEATURES=CD_LZ && python3 tools/lz.py pack file.bin file.lz &&
+//        build/cdsim --lz-bench file.lz file.bin
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cdsim.h"
+
+#define SECTOR_SIZE 0x800
+
+#ifdef CD_LZ
+static unsigned char* read_file(const char* path, long* size) {
+    unsigned char* data;
+    FILE* f = fopen(path, "rb");
+
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc(*size + 1);
+    if (data != NULL && fread(data, 1, *size, f) != (size_t)*size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+static double seconds(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int cdsim_lz_bench(const char* packed_path, const char* plain_path) {
+    long packed_size;
+    long plain_size;
+    unsigned char* packed = read_file(packed_path, &packed_size);
+    unsigned char* plain = read_file(plain_path, &plain_size);
+    unsigned char* out;
+    unsigned char* end = NULL;
+    unsigned int runs = 0;
+    double start;
+    double elapsed;
+    long i;
+
+    if (packed == NULL || plain == NULL || packed_size % SECTOR_SIZE != 0) {
+        fprintf(stderr, "cdsim: can't read %s and %s (sectors of tools/lz.py pack)\n", packed_path, plain_path);
+        return 2;
+    }
+    // slack past the end, a broken stream shouldn't take the host down
+    out = malloc(plain_size + 0x10000);
+    start = seconds();
+    do {
+        end = out;
+        for (i = 0; i < packed_size; i += SECTOR_SIZE) {
+            end = Cd_lz_decode(end, packed + i);
+        }
+        runs++;
+        elapsed = seconds() - start;
+    } while (elapsed < 1.0);
+
+    if (end - out != plain_size || memcmp(out, plain, plain_size) != 0) {
+        printf("MISMATCH: decoded 0x%lX bytes of 0x%lX\n", (long)(end - out), plain_size);
+        return 1;
+    }
+    printf("%ld -> %ld bytes (%.1f%%, %ld -> %ld sectors), %.1f MB/s decoded over %u runs\n", plain_size,
+           packed_size, 100.0 * packed_size / (plain_size ? plain_size : 1),
+           (plain_size + SECTOR_SIZE - 1) / SECTOR_SIZE, packed_size / SECTOR_SIZE,
+           (double)plain_size * runs / elapsed / 1e6, runs);
+    return 0;
+}
+#else
+int cdsim_lz_bench(const char* packed_path, const char* plain_path) {
+    fprintf(stderr, "cdsim: --lz-bench needs FEATURES=CD_LZ\n");
+    return 2;
+}
+#endif
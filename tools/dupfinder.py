@@ -0,0 +1,216 @@
+#!/usr/bin/env python3
+
+# Cross-overlay duplicate function finder
+#
+# Many stage archives carry near-identical PROGBIN overlays (ST03/ST03B, ST0C/ST0CB/ST0CC, ST10/ST10B...)
+# that are split and decompiled separately. This fingerprints every function of rock_neo and of every
+# overlay in one parallel pass:
+#   - every instruction is masked so that relocated fields (jal targets, %hi/%lo pairs, $gp offsets)
+#     don't count, then the masked words are hashed with a polynomial rolling hash
+#   - the whole-function hash finds exact duplicates
+#   - the rolling hash of every k-instruction window is a shingle, and a MinHash signature over the
+#     shingles (with LSH banding to find candidate pairs) finds near duplicates
+# Clusters that contain a function already decompiled in src/ are marked, that C can be reused as is.
+#
+# Usage: python3 tools/dupfinder.py [--threshold 0.85] [--json build/duplicates.json] [-j 8]
+
+import argparse
+import json
+import multiprocessing
+import os
+import random
+import re
+import sys
+
+sys.path.append(os.path.dirname(os.path.realpath(__file__)))
+import mips
+import modules
+import splat_asm
+
+SHINGLE = 4
+NUM_HASHES = 64
+BANDS = 16
+ROWS = NUM_HASHES // BANDS
+MIN_INSTRUCTIONS = 6
+
+MASK64 = (1 << 64) - 1
+PRIME = 0xFFFFFFFFFFFFFFC5  # largest 64-bit prime
+ROLL_BASE = 0x100000001B3
+
+rng = random.Random(0x4D4D4C31)
+HASH_PARAMS = [(rng.randrange(1, PRIME), rng.randrange(0, PRIME)) for _ in range(NUM_HASHES)]
+
+re_c_definition = re.compile(r"^[A-Za-z_][\w\s\*]*?\b(\w+)\s*\([^;]*\)\s*\{", re.MULTILINE)
+
+
+def mask_instructions(words):
+    """Replaces every field that a relocation or a different load address can change with zeroes."""
+    masked = []
+    hi_regs = set()
+    for word in words:
+        ins = mips.decode(word)
+        if ins.mnemonic in ("j", "jal"):
+            word &= 0xFC000000
+        elif ins.kind == mips.K_HI:
+            word &= 0xFFFF0000
+            hi_regs.add(ins.rt)
+        elif ins.fmt in ("tsi", "tsu", "to", "Go") and (ins.rs in hi_regs or ins.rs == 28):
+            # %lo() of a preceding lui, or a $gp relative access
+            word &= 0xFFFF0000
+        if ins.kind in (mips.K_BRANCH, mips.K_JUMP):
+            hi_regs.clear()
+        masked.append(word)
+    return masked
+
+
+def rolling_hashes(masked):
+    """Returns the hash of the whole sequence and the hash of every SHINGLE-long window."""
+    total = 0
+    for word in masked:
+        total = (total * ROLL_BASE + word + 1) & MASK64
+    shingles = set()
+    if len(masked) < SHINGLE:
+        shingles.add(total)
+        return total, shingles
+    top = pow(ROLL_BASE, SHINGLE - 1, 1 << 64)
+    window = 0
+    for i, word in enumerate(masked):
+        if i >= SHINGLE:
+            window = (window - (masked[i - SHINGLE] + 1) * top) & MASK64
+        window = (window * ROLL_BASE + word + 1) & MASK64
+        if i >= SHINGLE - 1:
+            shingles.add(window)
+    return total, shingles
+
+
+def minhash(shingles):
+    return tuple(min((a * s + b) % PRIME for s in shingles) for a, b in HASH_PARAMS)
+
+
+def fingerprint_module(module):
+    out = []
+    for fn in splat_asm.module_functions(module):
+        if len(fn.words) < MIN_INSTRUCTIONS:
+            continue
+        total, shingles = rolling_hashes(mask_instructions(fn.words))
+        out.append((module.name, fn.name, fn.vram, len(fn.words), total, minhash(shingles)))
+    return out
+
+
+def decompiled_functions():
+    names = set()
+    for dirpath, _, files in os.walk(modules.SRC_DIR):
+        for file in files:
+            if file.endswith(".c"):
+                with open(os.path.join(dirpath, file), "r", errors="replace") as f:
+                    names.update(re_c_definition.findall(f.read()))
+    return names
+
+
+class UnionFind:
+    def __init__(self, n):
+        self.parent = list(range(n))
+
+    def find(self, i):
+        while self.parent[i] != i:
+            self.parent[i] = self.parent[self.parent[i]]
+            i = self.parent[i]
+        return i
+
+    def union(self, a, b):
+        a, b = self.find(a), self.find(b)
+        if a != b:
+            self.parent[max(a, b)] = min(a, b)
+
+
+def similarity(a, b):
+    return sum(1 for x, y in zip(a, b) if x == y) / NUM_HASHES
+
+
+def cluster(entries, threshold):
+    exact = {}
+    for i, entry in enumerate(entries):
+        exact.setdefault(entry[4], []).append(i)
+
+    # near duplicates: only one representative of each exact group takes part
+    reps = [members[0] for members in exact.values()]
+    uf = UnionFind(len(entries))
+    for members in exact.values():
+        for i in members[1:]:
+            uf.union(members[0], i)
+    buckets = {}
+    for i in reps:
+        sig = entries[i][5]
+        for band in range(BANDS):
+            buckets.setdefault((band, sig[band * ROWS:(band + 1) * ROWS]), []).append(i)
+    scores = {}
+    for members in buckets.values():
+        if len(members) < 2:
+            continue
+        for x in range(len(members)):
+            for y in range(x + 1, len(members)):
+                a, b = members[x], members[y]
+                if (a, b) in scores:
+                    continue
+                # functions of very different lengths are never the same function
+                la, lb = entries[a][3], entries[b][3]
+                if min(la, lb) < max(la, lb) * threshold:
+                    continue
+                s = similarity(entries[a][5], entries[b][5])
+                scores[(a, b)] = s
+                if s >= threshold:
+                    uf.union(a, b)
+
+    groups = {}
+    for i in range(len(entries)):
+        groups.setdefault(uf.find(i), []).append(i)
+    clusters = []
+    for members in groups.values():
+        if len(members) < 2:
+            continue
+        exact_only = len({entries[i][4] for i in members}) == 1
+        pair_scores = [s for (a, b), s in scores.items() if uf.find(a) == uf.find(members[0]) and s >= threshold]
+        clusters.append((exact_only, min(pair_scores) if pair_scores else 1.0, members))
+    clusters.sort(key=lambda c: (not c[0], -len(c[2]), -entries[c[2][0]][3]))
+    return clusters
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Find duplicate functions across rock_neo and every overlay")
+    parser.add_argument("--threshold", type=float, default=0.85, help="estimated Jaccard similarity for near matches")
+    parser.add_argument("--json", default=None, help="also write the clusters to this file")
+    parser.add_argument("-j", dest="jobs", type=int, default=multiprocessing.cpu_count())
+    args = parser.parse_args()
+
+    all_modules = modules.all_modules()
+    with multiprocessing.Pool(args.jobs) as pool:
+        entries = [e for result in pool.imap_unordered(fingerprint_module, all_modules, chunksize=4) for e in result]
+    entries.sort(key=lambda e: (e[0], e[2]))
+    print(f"{len(entries)} functions in {len({e[0] for e in entries})} modules")
+
+    decompiled = decompiled_functions()
+    clusters = cluster(entries, args.threshold)
+    out = []
+    for exact_only, score, members in clusters:
+        kind = "exact" if exact_only else f"~{score:.2f}"
+        names = [entries[i] for i in members]
+        has_c = any(e[1] in decompiled for e in names)
+        print(f"\n[{kind}] {len(members)} functions, {names[0][3]} instructions{' (decompiled)' if has_c else ''}")
+        for module_name, name, vram, length, total, _ in names:
+            print(f"  {'*' if name in decompiled else ' '} {module_name:<48} {name:<32} 0x{vram:08X} {length}")
+        out.append({
+            "exact": exact_only,
+            "similarity": score,
+            "decompiled": has_c,
+            "functions": [{"module": e[0], "name": e[1], "vram": e[2], "instructions": e[3],
+                           "hash": f"{e[4]:016x}"} for e in names],
+        })
+    exact_count = sum(1 for c in clusters if c[0])
+    print(f"\n{exact_count} exact and {len(clusters) - exact_count} near duplicate clusters")
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(out, f, indent=1)
+
+
+if __name__ == "__main__":
+    main()
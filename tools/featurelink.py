@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+
+# Link check and entry point of a build with FEATURES
+#
+# config/feature.ld links src/rock_neo/feature outside the retail image, this makes sure it stayed
+# that way and fails the build otherwise:
+#   - the retail sections still end at FEATURE_RETAIL_END, where the features start
+#   - every symbol of config/syms.us.rock_neo.txt and of the undefined_*_auto lists that the link
+#     defines is at its retail address, and so is every func_/D_/jtbl_ symbol named after its address.
+#     The overlays call into rock_neo at those addresses
+# Then the executable is pointed at Feature_boot, which jumps to the retail entry written into
+# Feature_retail_entry, and its header gets the size of the file with the features.
+#
+# Usage: python3 tools/featurelink.py build/rock_neo.elf.unstripped build/rock_neo.exe
+
+import argparse
+import re
+import struct
+import sys
+
+import elftools.elf.elffile
+from elftools.elf.constants import SH_FLAGS
+from elftools.elf.sections import SymbolTableSection
+
+VERSION = "us"
+SYMBOL_LISTS = [
+    f"config/syms.{VERSION}.rock_neo.txt",
+    f"config/undefined_syms_auto.{VERSION}.rock_neo.txt",
+    f"config/undefined_funcs_auto.{VERSION}.rock_neo.txt",
+]
+ADDRESS_NAME = re.compile(r"^(?:func|D|jtbl)_(8[0-9A-Fa-f]{7})$")
+EXE_HEADER_SIZE = 0x800
+EXE_PC0 = 0x10
+EXE_T_ADDR = 0x18
+EXE_T_SIZE = 0x1C
+
+
+def read_symbol_list(path):
+    syms = {}
+    for line in open(path):
+        m = re.match(r"^\s*(\w+)\s*=\s*(0x[0-9A-Fa-f]+)\s*;", line)
+        if m:
+            syms[m.group(1)] = int(m.group(2), 16)
+    return syms
+
+
+def read_elf(path):
+    """Defined symbols (not absolute ones) by name, and the end of the retail sections."""
+    with open(path, "rb") as f:
+        elf = elftools.elf.elffile.ELFFile(f)
+        retail_end = 0
+        for section in elf.iter_sections():
+            if not section["sh_flags"] & SH_FLAGS.SHF_ALLOC or section.name.startswith(".feature"):
+                continue
+            retail_end = max(retail_end, section["sh_addr"] + section["sh_size"])
+        syms = {}
+        absolute = {}
+        for section in elf.iter_sections():
+            if not isinstance(section, SymbolTableSection):
+                continue
+            for sym in section.iter_symbols():
+                if sym.name == "" or sym["st_shndx"] == "SHN_UNDEF":
+                    continue
+                if sym["st_shndx"] == "SHN_ABS":
+                    absolute[sym.name] = sym["st_value"]
+                else:
+                    syms[sym.name] = sym["st_value"]
+    return syms, absolute, retail_end
+
+
+def check(syms, absolute, retail_end):
+    errors = []
+    if retail_end != absolute["FEATURE_RETAIL_END"]:
+        errors.append(f"the retail sections end at 0x{retail_end:08X}, "
+                      f"not 0x{absolute['FEATURE_RETAIL_END']:08X}")
+    expected = {}
+    for path in SYMBOL_LISTS:
+        expected.update(read_symbol_list(path))
+    for name, value in syms.items():
+        m = ADDRESS_NAME.match(name)
+        if m:
+            expected.setdefault(name, int(m.group(1), 16))
+    for name, address in sorted(expected.items(), key=lambda item: item[1]):
+        if name in syms and syms[name] != address:
+            errors.append(f"{name} moved from 0x{address:08X} to 0x{syms[name]:08X}")
+    return errors
+
+
+def patch_exe(path, syms):
+    data = bytearray(open(path, "rb").read())
+    t_addr = struct.unpack_from("<I", data, EXE_T_ADDR)[0]
+    pc0 = struct.unpack_from("<I", data, EXE_PC0)[0]
+    entry = syms["Feature_retail_entry"] - t_addr + EXE_HEADER_SIZE
+    struct.pack_into("<I", data, entry, pc0)
+    struct.pack_into("<I", data, EXE_PC0, syms["Feature_boot"])
+    data += bytes(-len(data) % EXE_HEADER_SIZE)
+    struct.pack_into("<I", data, EXE_T_SIZE, len(data) - EXE_HEADER_SIZE)
+    open(path, "wb").write(data)
+    return pc0, len(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Check and patch the executable of a build with FEATURES")
+    parser.add_argument("elf", help="the unstripped ELF, for its symbols")
+    parser.add_argument("exe", help="the executable objcopy made from it")
+    args = parser.parse_args()
+
+    syms, absolute, retail_end = read_elf(args.elf)
+    errors = check(syms, absolute, retail_end)
+    if errors:
+        for error in errors:
+            print(f"featurelink: {error}", file=sys.stderr)
+        sys.exit("featurelink: the features moved the retail image, see config/feature.ld")
+    pc0, size = patch_exe(args.exe, syms)
+    print(f"featurelink: entry 0x{syms['Feature_boot']:08X} (retail 0x{pc0:08X}), "
+          f"features 0x{syms['Feature_bss_end'] - syms['Feature_start']:X} bytes, exe 0x{size:X} bytes")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+
+# LZ codec of the compressed chunks (type CHUNK_LZ, see docs/CHUNKS.md), decoded by Cd_lz_decode in
+# src/rock_neo/feature/cd.c while the sectors stream in.
+#
+# The payload is a run of 0x800 byte sectors that decode on their own, so the CD layer never has to
+# keep a sequence across two sectors. Each sector starts with the length of its sequences (u16), then
+# LZ4 style sequences:
+#   token: literal count << 4 | (match length - 4)
+#   more literal count bytes if the count is 15, as long as they are 255
+#   the literals
+#   distance back into the output (u16, 1-65535)
+#   more match length bytes if the length is 19, as long as they are 255
+# The last sequence of a sector may stop after its literals. Matches point into what is already
+# decoded, the destination window itself is the dictionary.
+#
+# Usage: python3 tools/lz.py pack in.bin out.lz
+#        python3 tools/lz.py unpack in.lz out.bin
+
+import argparse
+import struct
+
+SECTOR_SIZE = 0x800
+SECTOR_ROOM = SECTOR_SIZE - 2
+MIN_MATCH = 4
+MAX_MATCH = 0x8000
+MAX_DISTANCE = 0xFFFF
+
+
+def extra(n):
+    """Bytes after the token to store a count of n in a 4 bit field."""
+    return 0 if n < 15 else (n - 15) // 255 + 1
+
+
+def put_count(out, n):
+    n -= 15
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+
+
+def match_length(data, a, b, limit):
+    n = 0
+    # compare in blocks first, slicing is much faster than a byte loop in python
+    while n + 16 <= limit and data[a + n:a + n + 16] == data[b + n:b + n + 16]:
+        n += 16
+    while n < limit and data[a + n] == data[b + n]:
+        n += 1
+    return n
+
+
+def sequences(data, depth=8):
+    """Greedy parse with hash chains: yields (literals, distance, match length), distance 0 at the end."""
+    heads = {}
+    chain = {}
+    literal_start = 0
+    i = 0
+    end = len(data) - MIN_MATCH
+    while i <= end:
+        key = data[i:i + MIN_MATCH]
+        best_length = 0
+        best_distance = 0
+        candidate = heads.get(key)
+        for _ in range(depth):
+            if candidate is None or i - candidate > MAX_DISTANCE:
+                break
+            length = match_length(data, candidate, i, min(MAX_MATCH, len(data) - i))
+            if length > best_length:
+                best_length, best_distance = length, i - candidate
+            candidate = chain.get(candidate)
+        if best_length < MIN_MATCH:
+            chain[i] = heads.get(key)
+            heads[key] = i
+            i += 1
+            continue
+        yield data[literal_start:i], best_distance, best_length
+        # index the start of the match and a few positions in it, every position is too slow
+        for j in range(i, min(i + best_length, end + 1), 1 if best_length < 32 else 4):
+            k = data[j:j + MIN_MATCH]
+            chain[j] = heads.get(k)
+            heads[k] = j
+        i += best_length
+        literal_start = i
+    yield data[literal_start:], 0, 0
+
+
+def encode_sequence(out, literals, distance, length):
+    n = len(literals)
+    m = length - MIN_MATCH if length else 0
+    out.append((min(n, 15) << 4) | min(m, 15))
+    if n >= 15:
+        put_count(out, n)
+    out += literals
+    if length:
+        out += struct.pack("<H", distance)
+        if m >= 15:
+            put_count(out, m)
+
+
+def sequence_size(n, length):
+    size = 1 + extra(n) + n
+    if length:
+        size += 2 + extra(length - MIN_MATCH)
+    return size
+
+
+def compress(data):
+    data = bytes(data)
+    sectors = []
+    current = bytearray()
+
+    def flush():
+        sectors.append(struct.pack("<H", len(current)) + bytes(current) + bytes(SECTOR_ROOM - len(current)))
+        current.clear()
+
+    for literals, distance, length in sequences(data):
+        while True:
+            if not literals and not length:
+                break
+            if len(current) + sequence_size(len(literals), length) <= SECTOR_ROOM:
+                encode_sequence(current, literals, distance, length)
+                break
+            # what fits of the literals closes the sector, the rest goes on in the next one
+            room = SECTOR_ROOM - len(current)
+            n = room - 1
+            while n > 0 and sequence_size(n, 0) > room:
+                n -= 1
+            if n > 0:
+                encode_sequence(current, literals[:n], 0, 0)
+                literals = literals[n:]
+            flush()
+    if current or not sectors:
+        flush()
+    return b"".join(sectors)
+
+
+def decompress(packed):
+    out = bytearray()
+    for base in range(0, len(packed), SECTOR_SIZE):
+        end = base + 2 + struct.unpack_from("<H", packed, base)[0]
+        i = base + 2
+        while i < end:
+            token = packed[i]
+            i += 1
+            n = token >> 4
+            if n == 15:
+                while True:
+                    n += packed[i]
+                    i += 1
+                    if packed[i - 1] != 255:
+                        break
+            out += packed[i:i + n]
+            i += n
+            if i >= end:
+                break
+            distance = struct.unpack_from("<H", packed, i)[0]
+            i += 2
+            length = token & 15
+            if length == 15:
+                while True:
+                    length += packed[i]
+                    i += 1
+                    if packed[i - 1] != 255:
+                        break
+            length += MIN_MATCH
+            for _ in range(length):
+                out.append(out[-distance])
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compress or expand a CHUNK_LZ payload")
+    parser.add_argument("mode", choices=["pack", "unpack"])
+    parser.add_argument("input")
+    parser.add_argument("output")
+    args = parser.parse_args()
+    with open(args.input, "rb") as f:
+        data = f.read()
+    if args.mode == "pack":
+        out = compress(data)
+        print(f"{len(data)} -> {len(out)} bytes ({(len(data) + SECTOR_SIZE - 1) // SECTOR_SIZE} -> {len(out) // SECTOR_SIZE} sectors)")
+    else:
+        out = decompress(data)
+    with open(args.output, "wb") as f:
+        f.write(out)
+
+
+if __name__ == "__main__":
+    main()
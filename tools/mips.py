@@ -0,0 +1,295 @@
+# MIPS R3000 (PSX) instruction decoder and scorer
+#
+# Pure python so that tools can compare code without spawning objdump. Only the instructions that can
+# appear in rock_neo and the overlays are handled: the R3000 base set, COP0 moves and the GTE (COP2).
+
+import difflib
+
+REGS = [
+    "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+    "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+    "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+    "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra",
+]
+
+# instruction kinds, used for scoring and masking
+K_ALU = 0
+K_LOAD = 1
+K_STORE = 2
+K_BRANCH = 3
+K_JUMP = 4
+K_HI = 5  # lui
+K_COP = 6
+K_OTHER = 7
+
+SPECIAL = {
+    0x00: ("sll", "dta"), 0x02: ("srl", "dta"), 0x03: ("sra", "dta"),
+    0x04: ("sllv", "dts"), 0x06: ("srlv", "dts"), 0x07: ("srav", "dts"),
+    0x08: ("jr", "s"), 0x09: ("jalr", "ds"),
+    0x0C: ("syscall", ""), 0x0D: ("break", ""),
+    0x10: ("mfhi", "d"), 0x11: ("mthi", "s"), 0x12: ("mflo", "d"), 0x13: ("mtlo", "s"),
+    0x18: ("mult", "st"), 0x19: ("multu", "st"), 0x1A: ("div", "st"), 0x1B: ("divu", "st"),
+    0x20: ("add", "dst"), 0x21: ("addu", "dst"), 0x22: ("sub", "dst"), 0x23: ("subu", "dst"),
+    0x24: ("and", "dst"), 0x25: ("or", "dst"), 0x26: ("xor", "dst"), 0x27: ("nor", "dst"),
+    0x2A: ("slt", "dst"), 0x2B: ("sltu", "dst"),
+}
+
+REGIMM = {0x00: "bltz", 0x01: "bgez", 0x10: "bltzal", 0x11: "bgezal"}
+
+OPCODES = {
+    0x02: ("j", "J", K_JUMP), 0x03: ("jal", "J", K_JUMP),
+    0x04: ("beq", "stB", K_BRANCH), 0x05: ("bne", "stB", K_BRANCH),
+    0x06: ("blez", "sB", K_BRANCH), 0x07: ("bgtz", "sB", K_BRANCH),
+    0x08: ("addi", "tsi", K_ALU), 0x09: ("addiu", "tsi", K_ALU),
+    0x0A: ("slti", "tsi", K_ALU), 0x0B: ("sltiu", "tsi", K_ALU),
+    0x0C: ("andi", "tsu", K_ALU), 0x0D: ("ori", "tsu", K_ALU), 0x0E: ("xori", "tsu", K_ALU),
+    0x0F: ("lui", "tu", K_HI),
+    0x20: ("lb", "to", K_LOAD), 0x21: ("lh", "to", K_LOAD), 0x22: ("lwl", "to", K_LOAD),
+    0x23: ("lw", "to", K_LOAD), 0x24: ("lbu", "to", K_LOAD), 0x25: ("lhu", "to", K_LOAD),
+    0x26: ("lwr", "to", K_LOAD),
+    0x28: ("sb", "to", K_STORE), 0x29: ("sh", "to", K_STORE), 0x2A: ("swl", "to", K_STORE),
+    0x2B: ("sw", "to", K_STORE), 0x2E: ("swr", "to", K_STORE),
+    0x32: ("lwc2", "Go", K_COP), 0x3A: ("swc2", "Go", K_COP),
+}
+
+COP_MOVES = {0x00: "mfc", 0x02: "cfc", 0x04: "mtc", 0x06: "ctc"}
+
+GTE_COMMANDS = {
+    0x01: "rtps", 0x06: "nclip", 0x0C: "op", 0x10: "dpcs", 0x11: "intpl", 0x12: "mvmva",
+    0x13: "ncds", 0x14: "cdp", 0x16: "ncdt", 0x1B: "nccs", 0x1C: "cc", 0x1E: "ncs",
+    0x20: "nct", 0x28: "sqr", 0x29: "dcpl", 0x2A: "dpct", 0x2D: "avsz3", 0x2E: "avsz4",
+    0x30: "rtpt", 0x3D: "gpf", 0x3E: "gpl", 0x3F: "ncct",
+}
+
+
+class Instruction:
+    __slots__ = ("word", "vram", "mnemonic", "kind", "rs", "rt", "rd", "sa", "imm", "target", "fmt")
+
+    def __init__(self, word, vram=0):
+        self.word = word
+        self.vram = vram
+        self.rs = (word >> 21) & 0x1F
+        self.rt = (word >> 16) & 0x1F
+        self.rd = (word >> 11) & 0x1F
+        self.sa = (word >> 6) & 0x1F
+        self.imm = word & 0xFFFF
+        self.target = word & 0x3FFFFFF
+        self.kind = K_OTHER
+        self.fmt = ""
+        self.mnemonic = "unknown"
+        self._decode()
+
+    def _decode(self):
+        word = self.word
+        op = word >> 26
+        if word == 0:
+            self.mnemonic = "nop"
+            self.kind = K_ALU
+        elif op == 0x00:
+            funct = word & 0x3F
+            if funct in SPECIAL:
+                self.mnemonic, self.fmt = SPECIAL[funct]
+                self.kind = K_JUMP if funct in (0x08, 0x09) else K_ALU
+        elif op == 0x01:
+            if self.rt in REGIMM:
+                self.mnemonic = REGIMM[self.rt]
+                self.fmt = "sB"
+                self.kind = K_BRANCH
+        elif op in OPCODES:
+            self.mnemonic, self.fmt, self.kind = OPCODES[op]
+        elif op in (0x10, 0x12):
+            cop = op & 3
+            self.kind = K_COP
+            if self.rs & 0x10:
+                if cop == 2:
+                    self.mnemonic = GTE_COMMANDS.get(word & 0x3F, "cop2")
+                    self.fmt = "C"
+                elif (word & 0x3F) == 0x10:
+                    self.mnemonic = "rfe"
+            elif self.rs in COP_MOVES:
+                self.mnemonic = f"{COP_MOVES[self.rs]}{cop}"
+                self.fmt = "tD"
+
+    @property
+    def signed_imm(self):
+        return self.imm - 0x10000 if self.imm & 0x8000 else self.imm
+
+    def branch_target(self):
+        if self.kind == K_BRANCH:
+            return (self.vram + 4 + (self.signed_imm << 2)) & 0xFFFFFFFF
+        if self.mnemonic in ("j", "jal"):
+            return ((self.vram + 4) & 0xF0000000) | (self.target << 2)
+        return None
+
+    def registers(self):
+        regs = []
+        for c in self.fmt:
+            if c == "s":
+                regs.append(self.rs)
+            elif c == "t":
+                regs.append(self.rt)
+            elif c == "d":
+                regs.append(self.rd)
+            elif c == "o":
+                regs.append(self.rs)
+        return tuple(regs)
+
+    def register_mask(self):
+        mask = 0
+        for c in self.fmt:
+            if c in "so":
+                mask |= 0x03E00000
+            elif c == "t":
+                mask |= 0x001F0000
+            elif c == "d":
+                mask |= 0x0000F800
+        return mask
+
+    def operands(self, symbols=None):
+        out = []
+        for c in self.fmt:
+            if c == "s":
+                out.append("$" + REGS[self.rs])
+            elif c == "t":
+                out.append("$" + REGS[self.rt])
+            elif c == "d":
+                out.append("$" + REGS[self.rd])
+            elif c == "D":
+                out.append(f"${self.rd}")
+            elif c == "G":
+                out.append(f"${self.rt}")
+            elif c == "a":
+                out.append(str(self.sa))
+            elif c == "i":
+                out.append(hex(self.signed_imm) if self.signed_imm >= 0 else "-" + hex(-self.signed_imm))
+            elif c == "u":
+                out.append(hex(self.imm))
+            elif c == "o":
+                imm = self.signed_imm
+                out.append(f"{hex(imm) if imm >= 0 else '-' + hex(-imm)}(${REGS[self.rs]})")
+            elif c in "BJ":
+                target = self.branch_target()
+                if symbols and target in symbols:
+                    out.append(symbols[target])
+                else:
+                    out.append(f"0x{target:08X}")
+            elif c == "C":
+                out.append(hex(self.word & 0x1FFFFFF))
+        return out
+
+    def text(self, symbols=None):
+        ops = self.operands(symbols)
+        if not ops:
+            return self.mnemonic
+        return f"{self.mnemonic:<8}{', '.join(ops)}"
+
+    def __repr__(self):
+        return self.text()
+
+
+def decode(word, vram=0):
+    return Instruction(word, vram)
+
+
+def words_from_bytes(data):
+    return [int.from_bytes(data[i:i + 4], "little") for i in range(0, len(data) - 3, 4)]
+
+
+def decode_bytes(data, vram=0):
+    return [Instruction(w, vram + i * 4) for i, w in enumerate(words_from_bytes(data))]
+
+
+# Scoring
+#
+# Same penalties as asm-differ's defaults so scores are comparable with what decomp-permuter prints:
+# a register-only difference is cheap, a different immediate a bit more, a different instruction or an
+# insertion/deletion is expensive. Fields that are filled in by relocations (jal targets, %hi/%lo pairs)
+# are ignored when the candidate instruction is relocated, since an unlinked object has them zeroed.
+
+PENALTY_REGALLOC = 10
+PENALTY_IMM = 20
+PENALTY_REORDER = 60
+PENALTY_INSERTION = 100
+PENALTY_DELETION = 100
+
+
+def masked_word(ins, relocated):
+    if not relocated:
+        return ins.word
+    if ins.mnemonic in ("j", "jal"):
+        return ins.word & 0xFC000000
+    return ins.word & 0xFFFF0000
+
+
+def pair_penalty(mine, good, relocated=False):
+    if mine.word == good.word:
+        return 0
+    if mine.mnemonic != good.mnemonic:
+        return PENALTY_INSERTION + PENALTY_DELETION
+    if masked_word(mine, relocated) == masked_word(good, relocated):
+        return 0
+    if mine.registers() != good.registers():
+        # only registers differ if everything outside the register fields agrees
+        mask = ~mine.register_mask()
+        if masked_word(mine, relocated) & mask == masked_word(good, relocated) & mask:
+            return PENALTY_REGALLOC
+        return PENALTY_REGALLOC + PENALTY_IMM
+    return PENALTY_IMM
+
+
+DIFF_EQUAL = " "
+DIFF_REGALLOC = "r"
+DIFF_IMM = "i"
+DIFF_REPLACE = "|"
+DIFF_DELETE = "<"
+DIFF_INSERT = ">"
+
+
+def classify(mine, good, relocated=False):
+    penalty = pair_penalty(mine, good, relocated)
+    if penalty == 0:
+        return DIFF_EQUAL, 0
+    if mine.mnemonic != good.mnemonic:
+        return DIFF_REPLACE, penalty
+    if penalty == PENALTY_IMM:
+        return DIFF_IMM, penalty
+    return DIFF_REGALLOC, penalty
+
+
+def align(mine, good, relocs=()):
+    """
+    Aligns two instruction lists on their mnemonics and classifies every row.
+    Returns a list of (tag, mine instruction or None, good instruction or None, penalty).
+    `relocs` is a set of `mine` indices that have a relocation applied.
+    """
+    relocs = set(relocs)
+    rows = []
+    matcher = difflib.SequenceMatcher(None, [i.mnemonic for i in mine], [i.mnemonic for i in good], autojunk=False)
+    for tag, i1, i2, j1, j2 in matcher.get_opcodes():
+        if tag == "equal":
+            for k in range(i2 - i1):
+                kind, penalty = classify(mine[i1 + k], good[j1 + k], (i1 + k) in relocs)
+                rows.append((kind, mine[i1 + k], good[j1 + k], penalty))
+        elif tag == "replace":
+            common = min(i2 - i1, j2 - j1)
+            for k in range(common):
+                rows.append((DIFF_REPLACE, mine[i1 + k], good[j1 + k], PENALTY_REORDER))
+            for k in range(i1 + common, i2):
+                rows.append((DIFF_DELETE, mine[k], None, PENALTY_DELETION))
+            for k in range(j1 + common, j2):
+                rows.append((DIFF_INSERT, None, good[k], PENALTY_INSERTION))
+        elif tag == "delete":
+            for k in range(i1, i2):
+                rows.append((DIFF_DELETE, mine[k], None, PENALTY_DELETION))
+        elif tag == "insert":
+            for k in range(j1, j2):
+                rows.append((DIFF_INSERT, None, good[k], PENALTY_INSERTION))
+    return rows
+
+
+def score(mine, good, relocs=()):
+    """
+    Scores a candidate instruction list against the target one, lower is better and 0 is a match.
+    `relocs` is a set of candidate instruction indices that have a relocation applied.
+    """
+    return sum(row[3] for row in align(mine, good, relocs))
@@ -0,0 +1,262 @@
+# Module layout helpers shared by the watch/permuter/diff tools
+#
+# A "module" is either the main executable (rock_neo) or a single chunk of a CDDATA/DAT archive
+# (e.g. ST1A/ovl0__progbin_r3_st1a.bin). For every module we know:
+#   - where its sources live (src/, asm/)
+#   - the built image and the retail image it has to match
+#   - how a vram address maps to a file offset in both images
+#   - the linker map that gives us per-function symbols
+#
+# rock_neo:  vram 0x80010000 is at file offset 0x800 of ROCK_NEO.EXE / build/rock_neo.exe
+# chunks:    the code segment (vram from the chunk's splat yaml) starts 0x800 past the chunk offset
+#            in the archive (build.json), right after the dashchunkheader
+
+import json
+import os
+import re
+
+VERSION = "us"
+
+ASM_DIR = "asm"
+SRC_DIR = "src"
+BUILD_DIR = "build"
+CONFIG_DIR = "config"
+DISK_DIR = f"disks/{VERSION}"
+
+ROCK_NEO = "rock_neo"
+ROCK_NEO_VRAM = 0x80010000
+EXE_HEADER_SIZE = 0x800
+CHUNK_HEADER_SIZE = 0x800
+
+# fixed load windows used by the stage/support overlays, see tools/generate_rock_neo_syms.py
+LOAD_ADDRESSES = {
+    "SUPPORT_STG_LOAD_ADDRESS": 0x801F6000,
+    "SUPPORT_EBD_LOAD_ADDRESS": 0x801F2000,
+    "SUPPORT_PROGBIN_LOAD_ADDRESS": 0x801D8000,
+    "STAGE_STG_LOAD_ADDRESS": 0x80194000,
+    "STAGE_EBD_LOAD_ADDRESS2": 0x80190000,
+    "STAGE_EBD_LOAD_ADDRESS1": 0x8016C000,
+    "STAGE_MDT_LOAD_ADDRESS": 0x80164000,
+    "STAGE_IDX_LOAD_ADDRESS": 0x8015C000,
+    "MSG_LOAD_ADDRESS": 0x80153000,
+    "STAGE_HED_LOAD_ADDRESS": 0x8013A000,
+    "STAGE_PROGBIN_LOAD_ADDRESS": 0x80100000,
+    "SHL_PROGBIN_LOAD_ADDRESS": 0x800D8800,
+}
+
+
+class Module:
+    def __init__(self, archive, chunk, vram, offset, size):
+        self.archive = archive  # None for rock_neo
+        self.chunk = chunk
+        self.vram = vram
+        self.offset = offset  # offset of the chunk (header included) in the archive
+        self.size = size
+
+    @property
+    def name(self):
+        if self.archive is None:
+            return ROCK_NEO
+        return f"{self.archive}/{self.chunk}"
+
+    @property
+    def is_rock_neo(self):
+        return self.archive is None
+
+    def src_dir(self):
+        if self.is_rock_neo:
+            return os.path.join(SRC_DIR, ROCK_NEO)
+        return os.path.join(SRC_DIR, self.archive, self.chunk)
+
+    def asm_dir(self):
+        if self.is_rock_neo:
+            return os.path.join(ASM_DIR, ROCK_NEO)
+        return os.path.join(ASM_DIR, self.archive, self.chunk)
+
+    def map_path(self):
+        if self.is_rock_neo:
+            return os.path.join(BUILD_DIR, f"{ROCK_NEO}.map")
+        return os.path.join(BUILD_DIR, f"{self.archive}.{self.chunk}.map")
+
+    def elf_path(self):
+        if self.is_rock_neo:
+            return os.path.join(BUILD_DIR, f"{ROCK_NEO}.elf")
+        return os.path.join(BUILD_DIR, f"{self.archive}.{self.chunk}.elf")
+
+    def built_image_path(self):
+        if self.is_rock_neo:
+            return os.path.join(BUILD_DIR, f"{ROCK_NEO}.exe")
+        return os.path.join(BUILD_DIR, f"{self.archive}.{self.chunk}.elf.bin")
+
+    def original_image_path(self):
+        if self.is_rock_neo:
+            return os.path.join(DISK_DIR, "ROCK_NEO.EXE")
+        return os.path.join(DISK_DIR, "CDDATA", "DAT", f"{self.archive}.BIN")
+
+    def built_offset(self, vram):
+        # the chunk .elf.bin starts at the chunk header, not at the archive start
+        if self.is_rock_neo:
+            return vram - self.vram + EXE_HEADER_SIZE
+        return vram - self.vram + CHUNK_HEADER_SIZE
+
+    def original_offset(self, vram):
+        if self.is_rock_neo:
+            return vram - self.vram + EXE_HEADER_SIZE
+        return self.offset + CHUNK_HEADER_SIZE + vram - self.vram
+
+    def contains(self, vram):
+        if self.size is None:
+            return vram >= self.vram
+        return self.vram <= vram < self.vram + self.size
+
+    def __repr__(self):
+        return f"Module({self.name}, 0x{self.vram:08X})"
+
+
+def rock_neo_module():
+    size = None
+    exe = os.path.join(DISK_DIR, "ROCK_NEO.EXE")
+    if os.path.exists(exe):
+        size = os.path.getsize(exe) - EXE_HEADER_SIZE
+    return Module(None, ROCK_NEO, ROCK_NEO_VRAM, 0, size)
+
+
+re_vram = re.compile(r"^\s*vram:\s*(0x[0-9A-Fa-f]+)", re.MULTILINE)
+
+
+def read_chunk_vram(archive, chunk):
+    yaml_path = os.path.join(CONFIG_DIR, "overlay", f"splat.{VERSION}.{archive}", f"{chunk}.yaml")
+    if not os.path.exists(yaml_path):
+        return None
+    with open(yaml_path, "r") as f:
+        match = re_vram.search(f.read())
+    if not match:
+        return None
+    return int(match.group(1), 16)
+
+
+def list_archives():
+    overlay_dir = os.path.join(CONFIG_DIR, "overlay")
+    return sorted(d.replace(f"splat.{VERSION}.", "") for d in os.listdir(overlay_dir)
+                  if d.startswith(f"splat.{VERSION}."))
+
+
+def archive_modules(archive):
+    json_path = os.path.join(CONFIG_DIR, "overlay", f"splat.{VERSION}.{archive}", "build.json")
+    with open(json_path, "r") as f:
+        data = json.load(f)
+    modules = []
+    for chunk, offset, chunk_type, size, unk in data["overlays"]:
+        if chunk == "ignore":
+            continue
+        vram = read_chunk_vram(archive, chunk)
+        if vram is None:
+            continue
+        modules.append(Module(archive, chunk, vram, offset, size))
+    return modules
+
+
+def all_modules():
+    modules = [rock_neo_module()]
+    for archive in list_archives():
+        modules += archive_modules(archive)
+    return modules
+
+
+def find_module(name):
+    if name == ROCK_NEO:
+        return rock_neo_module()
+    archive, _, chunk = name.partition("/")
+    for module in archive_modules(archive):
+        if not chunk or module.chunk == chunk:
+            return module
+    return None
+
+
+def module_for_path(path):
+    # src/rock_neo/..., asm/rock_neo/... -> rock_neo
+    # src/ST1A/ovl0__progbin_r3_st1a.bin/... -> ST1A/ovl0__progbin_r3_st1a.bin
+    parts = os.path.normpath(path).split(os.sep)
+    if len(parts) < 2 or parts[0] not in (SRC_DIR, ASM_DIR):
+        return None
+    if parts[1] == ROCK_NEO:
+        return rock_neo_module()
+    if len(parts) < 3:
+        return None
+    return find_module(f"{parts[1]}/{parts[2]}")
+
+
+# GNU ld map parsing
+#
+#  .text          0x80012000     0x1234 build/src/rock_neo/main.c.o
+#                 0x80012000                main
+re_map_input = re.compile(r"^\s*(\.\w+)?\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S+\.o)\s*$")
+re_map_symbol = re.compile(r"^\s+0x([0-9a-fA-F]+)\s+([A-Za-z_.$][\w.$]*)\s*$")
+
+
+class MapSymbol:
+    def __init__(self, name, vram, size, section, obj):
+        self.name = name
+        self.vram = vram
+        self.size = size
+        self.section = section
+        self.obj = obj
+
+    def __repr__(self):
+        return f"{self.name}@0x{self.vram:08X}+0x{self.size:X}"
+
+
+def parse_map(map_path):
+    """Returns every symbol of the map, sized up to the next symbol (or the end of its input section)."""
+    symbols = []
+    section = None
+    obj = None
+    obj_end = 0
+    pending = []
+
+    def flush():
+        pending.sort(key=lambda s: s.vram)
+        for i, sym in enumerate(pending):
+            end = pending[i + 1].vram if i + 1 < len(pending) else obj_end
+            sym.size = max(0, end - sym.vram)
+        symbols.extend(pending)
+        pending.clear()
+
+    with open(map_path, "r") as f:
+        for line in f:
+            match = re_map_input.match(line)
+            if match:
+                flush()
+                if match.group(1):
+                    section = match.group(1)
+                start, size = int(match.group(2), 16), int(match.group(3), 16)
+                obj = match.group(4)
+                obj_end = start + size
+                continue
+            if line.startswith(" .") or line.startswith("."):
+                # new output/input section without an object on the same line
+                flush()
+                parts = line.split()
+                section = parts[0] if parts else section
+                obj = None
+                continue
+            match = re_map_symbol.match(line)
+            if match and obj is not None:
+                vram = int(match.group(1), 16)
+                if vram < obj_end or obj_end == 0:
+                    pending.append(MapSymbol(match.group(2), vram, 0, section, obj))
+    flush()
+    return symbols
+
+
+def text_symbols(map_path, objs=None):
+    syms = [s for s in parse_map(map_path) if s.section == ".text" and s.size > 0]
+    if objs is not None:
+        syms = [s for s in syms if s.obj in objs]
+    return syms
+
+
+def read_range(path, offset, size):
+    with open(path, "rb") as f:
+        f.seek(offset)
+        return f.read(size)
@@ -0,0 +1,40 @@
+// Built with the game headers before the bench: the build fails when the copies of tools/mojibench/mojibench.h
+// no longer match include/rock_neo/moji_glyph.h. Nothing of it is linked
+
+#include "rock_neo/moji_glyph.h"
+
+enum { GAME_LAYOUT_CELLS = MOJI_LAYOUT_CELLS };
+typedef PRIM_RETAINED GAME_PRIM_RETAINED;
+typedef MOJI_WINDOW GAME_MOJI_WINDOW;
+
+#undef MOJI_LAYOUT_CELLS
+#define PRIM_RETAINED BENCH_PRIM_RETAINED
+#define MOJI_WINDOW BENCH_MOJI_WINDOW
+#include "mojibench.h"
+
+#define SAME_FIELD(type, field)                                                                                  \
+    _Static_assert(__builtin_offsetof(GAME_##type, field) == __builtin_offsetof(BENCH_##type, field) &&         \
+                       sizeof(((GAME_##type*)0)->field) == sizeof(((BENCH_##type*)0)->field),                  \
+                   "tools/mojibench/mojibench.h: " #type "." #field " moved")
+
+_Static_assert(sizeof(GAME_PRIM_RETAINED) == sizeof(BENCH_PRIM_RETAINED), "PRIM_RETAINED changed size");
+SAME_FIELD(PRIM_RETAINED, copy);
+SAME_FIELD(PRIM_RETAINED, ot);
+SAME_FIELD(PRIM_RETAINED, key);
+SAME_FIELD(PRIM_RETAINED, built);
+SAME_FIELD(PRIM_RETAINED, rebuild);
+
+_Static_assert(sizeof(GAME_MOJI_WINDOW) == sizeof(BENCH_MOJI_WINDOW), "MOJI_WINDOW changed size");
+SAME_FIELD(MOJI_WINDOW, prims);
+SAME_FIELD(MOJI_WINDOW, text);
+SAME_FIELD(MOJI_WINDOW, glyph);
+SAME_FIELD(MOJI_WINDOW, dirty);
+SAME_FIELD(MOJI_WINDOW, x);
+SAME_FIELD(MOJI_WINDOW, y);
+SAME_FIELD(MOJI_WINDOW, cols);
+SAME_FIELD(MOJI_WINDOW, rows);
+SAME_FIELD(MOJI_WINDOW, style);
+SAME_FIELD(MOJI_WINDOW, clut);
+SAME_FIELD(MOJI_WINDOW, generation);
+
+_Static_assert(GAME_LAYOUT_CELLS == MOJI_LAYOUT_CELLS, "MOJI_LAYOUT_CELLS changed");
@@ -0,0 +1,200 @@
+// Message layout of the MOJI_SCRIPTS text windows (src/rock_neo/feature/moji.c) on the host
+//
+// Every message of a bank compiled by tools/msgc.py is shown page by page, over and over for about a
+// second each way: wrapped at run time from its text (Moji_window_text, the --plain output) and from
+// its compiled ops (Moji_script_page). Both have to leave the same cells in the window on every page.
+// Host numbers only compare the two paths with each other, not with the console.
+//
+// tools/mojibench/messages.txt holds the cases the two have to agree on, like control bytes between words.
+//
+// Usage: python3 tools/msgc.py compile tools/mojibench/messages.txt build/messages.msc
+//            --plain build/messages.plain && make mojibench && build/mojibench build/messages.msc build/messages.plain
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mojibench.h"
+
+// moji.c
+void Moji_window_init(MOJI_WINDOW* w, int x, int y, unsigned int style, unsigned short clut);
+const char* Moji_window_text(MOJI_WINDOW* w, const char* text);
+const unsigned char* Moji_script_message(MOJI_WINDOW* w, const unsigned char* bank, unsigned int index);
+const unsigned char* Moji_script_page(MOJI_WINDOW* w, const unsigned char* ops);
+
+// what moji.c links against in the game, the bench never draws
+unsigned int Frame_count;
+
+void* Prim_retained(PRIM_RETAINED* r, unsigned int key) {
+    return r->copy[0];
+}
+
+unsigned int Vram_reserve_conflicts;
+
+void Vram_load(void* rect, void* p) {
+}
+
+int DrawSync(int mode) {
+    return 0;
+}
+
+void AddPrim(void* ot, void* p) {
+}
+
+unsigned short GetTPage(int tp, int abr, int x, int y) {
+    return 0;
+}
+
+void SetDrawMode(void* p, int dfe, int dtd, int tpage, void* tw) {
+}
+
+static unsigned char* read_file(const char* path, long* size) {
+    unsigned char* data;
+    FILE* f = fopen(path, "rb");
+
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc(*size + 1);
+    if (data != NULL && fread(data, 1, *size, f) != (size_t)*size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+static double seconds(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// pages of every message, each way
+static unsigned int show_text(MOJI_WINDOW* w, const char* const* messages, unsigned int count) {
+    unsigned int pages = 0;
+    const char* text;
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        for (text = messages[i]; text != NULL; pages++) {
+            text = Moji_window_text(w, text);
+        }
+    }
+    return pages;
+}
+
+static unsigned int show_script(MOJI_WINDOW* w, const unsigned char* bank, unsigned int count) {
+    unsigned int pages = 0;
+    const unsigned char* ops;
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        for (ops = Moji_script_message(w, bank, i); ops != NULL; pages++) {
+            ops = Moji_script_page(w, ops);
+        }
+    }
+    return pages;
+}
+
+static double bench(MOJI_WINDOW* w, const char* const* messages, const unsigned char* bank, unsigned int count,
+                    unsigned int* pages) {
+    unsigned int runs = 0;
+    double start = seconds();
+    double elapsed;
+
+    do {
+        *pages = bank != NULL ? show_script(w, bank, count) : show_text(w, messages, count);
+        runs++;
+        elapsed = seconds() - start;
+    } while (elapsed < 1.0);
+    return elapsed * 1e9 / runs / (count ? count : 1);
+}
+
+int main(int argc, char** argv) {
+    long bank_size;
+    long plain_size;
+    unsigned char* bank;
+    unsigned char* plain;
+    const char** messages;
+    const char* text;
+    const unsigned char* ops;
+    unsigned int count;
+    unsigned int cells;
+    unsigned short* expected;
+    unsigned int text_pages;
+    unsigned int script_pages;
+    double text_ns;
+    double script_ns;
+    unsigned int i;
+    long at;
+    MOJI_WINDOW w;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: mojibench bank.msc bank.plain\n");
+        return 2;
+    }
+    bank = read_file(argv[1], &bank_size);
+    plain = read_file(argv[2], &plain_size);
+    if (bank == NULL || plain == NULL || bank_size < 8 || memcmp(bank, "MSC0", 4) != 0) {
+        fprintf(stderr, "mojibench: can't read %s and %s (tools/msgc.py compile --plain)\n", argv[1], argv[2]);
+        return 2;
+    }
+    count = bank[4] | bank[5] << 8;
+    messages = malloc(count * sizeof(*messages));
+    plain[plain_size] = 0;
+    for (i = 0, at = 0; i < count; i++) {
+        if (at >= plain_size) {
+            fprintf(stderr, "mojibench: %s has fewer messages than %s\n", argv[2], argv[1]);
+            return 2;
+        }
+        messages[i] = (const char*)plain + at;
+        at += strlen(messages[i]) + 1;
+    }
+
+    memset(&w, 0, sizeof(w));
+    w.cols = bank[6];
+    w.rows = bank[7];
+    cells = w.cols * w.rows;
+    if (cells > MOJI_LAYOUT_CELLS) {
+        fprintf(stderr, "mojibench: %ux%u is more than the %u cells of the layout\n", w.cols, w.rows,
+                MOJI_LAYOUT_CELLS);
+        return 2;
+    }
+    w.text = calloc(cells, sizeof(*w.text));
+    w.glyph = calloc(cells, sizeof(*w.glyph));
+    w.dirty = calloc(cells, 1);
+    expected = malloc(cells * sizeof(*expected));
+    Moji_window_init(&w, 0, 0, 0, 0);
+
+    // both ways, page by page
+    for (i = 0; i < count; i++) {
+        text = messages[i];
+        ops = Moji_script_message(&w, bank, i);
+        for (text_pages = 0; text != NULL && ops != NULL; text_pages++) {
+            text = Moji_window_text(&w, text);
+            memcpy(expected, w.text, cells * sizeof(*expected));
+            ops = Moji_script_page(&w, ops);
+            if (memcmp(expected, w.text, cells * sizeof(*expected)) != 0) {
+                printf("MISMATCH: message %u page %u\n", i, text_pages);
+                return 1;
+            }
+        }
+        if (text != NULL || ops != NULL) {
+            printf("MISMATCH: message %u has more pages as %s\n", i, text != NULL ? "text" : "script");
+            return 1;
+        }
+    }
+
+    text_ns = bench(&w, messages, NULL, count, &text_pages);
+    script_ns = bench(&w, messages, bank, count, &script_pages);
+    printf("%u messages, %u pages of %ux%u, %ld bytes compiled (%ld as text)\n", count, script_pages, w.cols, w.rows,
+           bank_size, plain_size);
+    printf("text %.0f ns/message, script %.0f ns/message (%.2fx)\n", text_ns, script_ns, text_ns / script_ns);
+    return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef MOJIBENCH_H
+#define MOJIBENCH_H
+
+// the types of include/rock_neo/moji_glyph.h that the bench touches. The game headers can't go next to the
+// C library ones (include/types.h has its own size_t), tools/mojibench/layout.c checks these copies
+// against them when the bench is built
+typedef struct {
+    void* copy[2];
+    void* ot[2];
+    unsigned int key[2];
+    unsigned char built;
+    unsigned char rebuild;
+} PRIM_RETAINED;
+
+typedef struct {
+    PRIM_RETAINED prims;
+    unsigned short* text;
+    unsigned short* glyph;
+    unsigned char* dirty;
+    short x, y;
+    unsigned char cols, rows;
+    unsigned char style;
+    unsigned short clut;
+    unsigned char generation;
+} MOJI_WINDOW;
+
+// a bigger window is only laid out in part
+#define MOJI_LAYOUT_CELLS 1024
+
+#endif
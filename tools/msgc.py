@@ -0,0 +1,222 @@
+#!/usr/bin/env python3
+
+# Message script compiler for the text windows of FEATURES=MOJI_SCRIPTS (see Moji_script_page in
+# src/rock_neo/feature/moji.c)
+#
+# The retail message banks (the ..\MESS\*.MSG chunks of the stage archives, loaded at 0x80153000) are
+# bytecode run by the Moji tasks, which are still in asm, and their encoding isn't mapped yet. "list"
+# finds them in the archives and dumps them for that work. "compile" takes messages written as text
+# and does everything the window would otherwise do at run time: lines are wrapped to the width of the
+# window, pages cut to its height and characters turned into glyph codes, so showing a page is only
+# copying runs of codes into cells.
+#
+# Source text:
+#   # comment
+#   @name         starts a message
+#   a line        wrapped at spaces to --cols, every line starts a new row, an empty one leaves a row blank
+#   {page}        waits for a button and starts a new page, so does running out of --rows
+#
+# Compiled bank (little endian):
+#   "MSC0", u16 message count, u8 cols, u8 rows, u32 offset of every message from the start
+#   then per message, ops:
+#     0x00          end of the message
+#     0x01 row      cursor to the start of row
+#     0x02          end of the page
+#     0x03 u16      one cell of a glyph code above 0xFF
+#     0x80 | n      n cells (1-127) of the glyph codes that follow, a byte each
+#
+# --plain writes the same messages in the form Moji_window_text lays out at run time ('\n' between
+# lines, '\f' between pages, NUL after each message), for build/mojibench to compare both paths.
+#
+# Usage: python3 tools/msgc.py compile messages.txt build/messages.msc [--cols 24 --rows 4]
+#            [--charmap map.txt] [--plain build/messages.plain]
+#        python3 tools/msgc.py list disks/us/CDDATA/DAT/ST04.BIN [...] [--dump build/mess]
+
+import argparse
+import os
+import re
+import struct
+
+SECTOR_SIZE = 0x800
+CHUNK_END = 0xFFFFFFFF
+
+OP_END = 0x00
+OP_ROW = 0x01
+OP_PAGE = 0x02
+OP_CODE = 0x03
+OP_RUN = 0x80
+RUN_MAX = 0x7F
+# what separates words for Moji_window_text: a space and every control byte ('\n' and '\f' never get here)
+WORD_SEPARATORS = re.compile("[\x00-\x20]+")
+
+
+def read_source(path):
+    """Returns [(name, [line or None for a page break])]."""
+    messages = []
+    # only '\n' ends a line, a '\r' stays in it as a separator
+    with open(path, "r", encoding="utf-8", newline="\n") as f:
+        for number, line in enumerate(f, 1):
+            line = line.rstrip("\n")
+            if line.startswith("#"):
+                continue
+            if line.startswith("@"):
+                messages.append((line[1:].strip(), []))
+                continue
+            if not messages:
+                if line.strip():
+                    raise SystemExit(f"{path}:{number}: text before the first @name")
+                continue
+            messages[-1][1].append(None if line.strip() == "{page}" else line)
+    for name, lines in messages:
+        # the blank lines between two messages aren't part of either
+        while lines and lines[-1] == "":
+            lines.pop()
+    return messages
+
+
+def read_charmap(path):
+    """Returns {character: glyph code} from lines of 'character code'."""
+    charmap = {}
+    with open(path, "r", encoding="utf-8") as f:
+        for line in f:
+            if not line.strip() or line.startswith("#"):
+                continue
+            char, code = line.rstrip("\n").rsplit(" ", 1)
+            charmap[char if char else " "] = int(code, 0)
+    return charmap
+
+
+def layout(lines, cols, rows):
+    """Greedy word wrap, the same as Moji_window_text: returns pages of rows of text."""
+    pages = [[]]
+
+    def new_row():
+        if len(pages[-1]) == rows:
+            pages.append([])
+        pages[-1].append("")
+
+    for line in lines:
+        if line is None:
+            pages.append([])
+            continue
+        new_row()
+        for word in filter(None, WORD_SEPARATORS.split(line)):
+            row = pages[-1][-1]
+            if row and len(row) + 1 + len(word) > cols:
+                new_row()
+            elif row:
+                pages[-1][-1] += " "
+            # a word longer than the window is cut
+            while len(pages[-1][-1]) + len(word) > cols:
+                room = cols - len(pages[-1][-1])
+                pages[-1][-1] += word[:room]
+                word = word[room:]
+                new_row()
+            pages[-1][-1] += word
+    return pages
+
+
+def compile_message(lines, cols, rows, charmap):
+    out = bytearray()
+    pages = layout(lines, cols, rows)
+    for index, page in enumerate(pages):
+        if index:
+            out.append(OP_PAGE)
+        for row, text in enumerate(page):
+            text = text.rstrip()
+            if not text:
+                continue
+            out += bytes((OP_ROW, row))
+            codes = [charmap.get(c, ord(c)) for c in text]
+            i = 0
+            while i < len(codes):
+                if codes[i] > 0xFF:
+                    out.append(OP_CODE)
+                    out += struct.pack("<H", codes[i])
+                    i += 1
+                    continue
+                n = 0
+                while i + n < len(codes) and n < RUN_MAX and codes[i + n] <= 0xFF:
+                    n += 1
+                out.append(OP_RUN | n)
+                out += bytes(codes[i:i + n])
+                i += n
+    out.append(OP_END)
+    return bytes(out)
+
+
+def plain_message(lines):
+    text = ""
+    for line in lines:
+        if line is None:
+            # the page break ends the line instead of the '\n', the blank lines before it stay
+            text = (text[:-1] if text.endswith("\n") else text) + "\f"
+        else:
+            text += line + "\n"
+    return (text[:-1] if text.endswith("\n") else text).encode("latin-1") + b"\0"
+
+
+def compile_bank(args):
+    messages = read_source(args.source)
+    charmap = read_charmap(args.charmap) if args.charmap else {}
+    bodies = [compile_message(lines, args.cols, args.rows, charmap) for _, lines in messages]
+    header_size = 8 + 4 * len(bodies)
+    offsets = []
+    offset = header_size
+    for body in bodies:
+        offsets.append(offset)
+        offset += len(body)
+    out = b"MSC0" + struct.pack("<HBB", len(bodies), args.cols, args.rows)
+    out += b"".join(struct.pack("<I", o) for o in offsets) + b"".join(bodies)
+    os.makedirs(os.path.dirname(args.output) or ".", exist_ok=True)
+    with open(args.output, "wb") as f:
+        f.write(out)
+    plain = b"".join(plain_message(lines) for _, lines in messages)
+    if args.plain:
+        with open(args.plain, "wb") as f:
+            f.write(plain)
+    print(f"{len(bodies)} messages, {len(out)} bytes compiled ({len(plain)} as text)")
+
+
+def list_banks(args):
+    for path in args.archives:
+        with open(path, "rb") as f:
+            data = f.read()
+        offset = 0
+        while offset + SECTOR_SIZE <= len(data):
+            chunk_type, size, _, load_address = struct.unpack_from("<IIII", data, offset)
+            if chunk_type == CHUNK_END:
+                break
+            name = data[offset + 0x40:offset + SECTOR_SIZE].split(b"\0")[0].decode("ascii", errors="replace")
+            if name.upper().endswith(".MSG"):
+                print(f"{path}: {name} type {chunk_type:X} 0x{size:X} bytes at 0x{load_address:08X}")
+                if args.dump:
+                    os.makedirs(args.dump, exist_ok=True)
+                    base = os.path.basename(name.replace("\\", "/"))
+                    with open(os.path.join(args.dump, base), "wb") as out:
+                        out.write(data[offset + SECTOR_SIZE:offset + SECTOR_SIZE + size])
+            offset += SECTOR_SIZE + ((size + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compile messages for the Moji text windows")
+    sub = parser.add_subparsers(dest="mode", required=True)
+    p = sub.add_parser("compile")
+    p.add_argument("source")
+    p.add_argument("output")
+    p.add_argument("--cols", type=int, default=24)
+    p.add_argument("--rows", type=int, default=4)
+    p.add_argument("--charmap", help="lines of 'character glyph code', the others are their own code")
+    p.add_argument("--plain", help="the messages as text, for build/mojibench")
+    p = sub.add_parser("list")
+    p.add_argument("archives", nargs="+")
+    p.add_argument("--dump", help="directory to write the MSG chunks to")
+    args = parser.parse_args()
+    if args.mode == "compile":
+        compile_bank(args)
+    else:
+        list_banks(args)
+
+
+if __name__ == "__main__":
+    main()
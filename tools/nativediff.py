@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+
+# Native instruction-level diff of one function against the retail image
+#
+# Reads the built image and the retail one directly (ROCK_NEO.EXE, or the chunk of a CDDATA/DAT
+# archive selected by vram range), decodes both with tools/mips.py and aligns them with register and
+# immediate aware scoring. Decoded retail functions are cached, in memory for --watch and on disk in
+# build/nativediff/, so a redraw only has to decode our side.
+#
+# Usage: python3 tools/nativediff.py func_80016DAC [--module ST1A/ovl0__progbin_r3_st1a.bin] [--watch]
+#
+# It also writes build/<ARCHIVE>.<chunk>.good.bin (the retail chunk, same layout as the built
+# <ARCHIVE>.<chunk>.elf.bin) which diff_settings.py uses as the asm-differ base image for overlays.
+
+import argparse
+import os
+import pickle
+import sys
+import time
+
+sys.path.append(os.path.dirname(os.path.realpath(__file__)))
+import mips
+import modules
+
+CACHE_DIR = os.path.join(modules.BUILD_DIR, "nativediff")
+
+COLORS = {
+    mips.DIFF_EQUAL: "",
+    mips.DIFF_REGALLOC: "\033[93m",
+    mips.DIFF_IMM: "\033[96m",
+    mips.DIFF_REPLACE: "\033[91m",
+    mips.DIFF_DELETE: "\033[91m",
+    mips.DIFF_INSERT: "\033[92m",
+}
+RESET = "\033[0m"
+
+
+class OriginalCache:
+    def __init__(self):
+        self.memory = {}
+        os.makedirs(CACHE_DIR, exist_ok=True)
+
+    def path(self, module, sym):
+        return os.path.join(CACHE_DIR, f"{module.name.replace('/', '.')}.{sym.name}.pickle")
+
+    def get(self, module, sym):
+        key = (module.name, sym.vram, sym.size)
+        if key in self.memory:
+            return self.memory[key]
+        path = self.path(module, sym)
+        if os.path.exists(path):
+            with open(path, "rb") as f:
+                cached_key, words = pickle.load(f)
+            if cached_key == key:
+                instructions = [mips.decode(w, sym.vram + i * 4) for i, w in enumerate(words)]
+                self.memory[key] = instructions
+                return instructions
+        data = modules.read_range(module.original_image_path(), module.original_offset(sym.vram), sym.size)
+        instructions = mips.decode_bytes(data, sym.vram)
+        with open(path, "wb") as f:
+            pickle.dump((key, [i.word for i in instructions]), f)
+        self.memory[key] = instructions
+        return instructions
+
+
+def extract_original_chunk(module):
+    # the retail chunk (header included), byte for byte comparable with <ARCHIVE>.<chunk>.elf.bin
+    path = os.path.join(modules.BUILD_DIR, f"{module.archive}.{module.chunk}.good.bin")
+    if not os.path.exists(path):
+        data = modules.read_range(module.original_image_path(), module.offset,
+                                  modules.CHUNK_HEADER_SIZE + module.size)
+        with open(path, "wb") as f:
+            f.write(data)
+    return path
+
+
+def find_function(name, module_name=None):
+    candidates = [modules.find_module(module_name)] if module_name else modules.all_modules()
+    for module in candidates:
+        if module is None or not os.path.exists(module.map_path()):
+            continue
+        for sym in modules.text_symbols(module.map_path()):
+            if sym.name == name:
+                return module, sym
+    return None, None
+
+
+def symbol_names(module):
+    return {sym.vram: sym.name for sym in modules.parse_map(module.map_path())}
+
+
+def render(module, sym, originals, width):
+    mine = mips.decode_bytes(modules.read_range(module.built_image_path(), module.built_offset(sym.vram), sym.size),
+                             sym.vram)
+    good = originals.get(module, sym)
+    rows = mips.align(mine, good)
+    names = symbol_names(module)
+    total = sum(row[3] for row in rows)
+    column = (width - 6) // 2
+    lines = [f"{sym.name} ({module.name}) 0x{sym.vram:08X}  score {total}", ""]
+    for tag, a, b, _ in rows:
+        left = f"{a.vram & 0xFFFFFF:06X}: {a.text(names)}" if a else ""
+        right = f"{b.vram & 0xFFFFFF:06X}: {b.text(names)}" if b else ""
+        color = COLORS[tag] if sys.stdout.isatty() else ""
+        lines.append(f"{color}{left[:column]:<{column}} {tag} {right[:column]}{RESET if color else ''}")
+    return "\n".join(lines), total
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Diff a function against the retail image without objdump")
+    parser.add_argument("function")
+    parser.add_argument("--module", default=None, help="rock_neo or ARCHIVE/chunk, searched if omitted")
+    parser.add_argument("--watch", action="store_true", help="redraw whenever the built image changes")
+    parser.add_argument("--width", type=int, default=None)
+    args = parser.parse_args()
+
+    module, sym = find_function(args.function, args.module)
+    if module is None:
+        sys.exit(f"{args.function} not found in any map file, build first")
+    if not module.is_rock_neo:
+        extract_original_chunk(module)
+    width = args.width or (os.get_terminal_size().columns if sys.stdout.isatty() else 160)
+    originals = OriginalCache()
+
+    if not args.watch:
+        text, total = render(module, sym, originals, width)
+        print(text)
+        sys.exit(0 if total == 0 else 1)
+
+    last = None
+    try:
+        while True:
+            stamp = (os.stat(module.built_image_path()).st_mtime_ns, os.stat(module.map_path()).st_mtime_ns)
+            if stamp != last:
+                last = stamp
+                # the function may have grown or moved
+                module, sym = find_function(args.function, module.name)
+                if sym is not None:
+                    start = time.time()
+                    text, _ = render(module, sym, originals, width)
+                    sys.stdout.write("\033[H\033[2J" + text + f"\n\n[{(time.time() - start) * 1000:.1f} ms]\n")
+                    sys.stdout.flush()
+            time.sleep(0.05)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,425 @@
+#!/usr/bin/env python3
+
+# Parallel permuter for functions that don't match yet
+#
+# Searches random source permutations of one function until the compiled code matches the target asm.
+# The source is preprocessed once with PERMUTER defined (so every INCLUDE_ASM vanishes and the object only
+# holds C functions), and the mutations are applied to that preprocessed text. Every worker process
+# runs maspsx and patchasm in-process, feeds candidates to cc1 and as through pipes and scores the
+# resulting object in-process with tools/mips.py, so there is no objdump and no shared state between
+# workers: the search scales with the number of cores. cc1 and as can't stay resident, so they are
+# still started once per candidate; the summary gives the time per candidate of each stage.
+#
+# Usage: python3 tools/permuter.py src/rock_neo/game.c func_80015734 [-j 8] [--time 600]
+# Better candidates are written to build/permuter/<function>/output-<score>-<n>.c
+
+import argparse
+import contextlib
+import io
+import multiprocessing
+import os
+import queue
+import random
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+sys.path.append(os.path.dirname(os.path.realpath(__file__)))
+import mips
+import modules
+
+CROSS = os.environ.get("CROSS", "mipsel-elf-")
+AS = f"{CROSS}as"
+CPP = f"{CROSS}cpp"
+CC = "./bin/cc1-27"
+AS_FLAGS = ["-Iinclude", "-march=r3000", "-mtune=r3000", "-no-pad-sections", "-O1", "-G0"]
+CC_FLAGS_ROCK_NEO = "-mcpu=3000 -quiet -w -O2 -funsigned-char -fpeephole -ffunction-cse -fpcc-struct-return -fcommon -fverbose-asm -fgnu-linker -mgas -msoft-float -G8 -gcoff".split()
+CC_FLAGS_OVERLAY = "-mcpu=3000 -quiet -G0 -w -O2 -funsigned-char -fpeephole -ffunction-cse -fpcc-struct-return -fcommon -fverbose-asm -fgnu-linker -mgas -msoft-float -gcoff".split()
+CPP_FLAGS = "-Iinclude -undef -Wall -lang-c -fno-builtin -Dmips -D__GNUC__=2 -D__OPTIMIZE__ -D__mips__ -D__mips -Dpsx -D__psx__ -D__psx -D_PSYQ -D__EXTENSIONS__ -D_MIPSEL -D_LANGUAGE_C -DLANGUAGE_C -DHACKS -DPERMUTER".split()
+MASPSX = ["python3", "tools/maspx/maspsx.py", "--no-macro-inc", "--expand-div"]
+
+OUTPUT_DIR = os.path.join(modules.BUILD_DIR, "permuter")
+
+re_include_asm = re.compile(r'INCLUDE_ASM\(\s*"([^"]+)"\s*,\s*(\w+)\s*\)')
+re_asm_word = re.compile(r"/\*\s*[0-9A-Fa-f]+\s+[0-9A-Fa-f]{8}\s+([0-9A-Fa-f]{8})\s*\*/")
+
+
+# Target
+
+def find_target_asm(c_file, func):
+    with open(c_file, "r") as f:
+        text = f.read()
+    for folder, name in re_include_asm.findall(text):
+        if name == func:
+            return os.path.normpath(os.path.join(folder, f"{func}.s"))
+    return None
+
+
+def read_target(asm_file):
+    words = []
+    with open(asm_file, "r") as f:
+        for line in f:
+            match = re_asm_word.search(line)
+            if match:
+                words.append(int(match.group(1), 16))
+    return [mips.decode(w) for w in words]
+
+
+# Source
+
+def find_function(text, func):
+    """Returns (start, end) of the definition of `func` in preprocessed C, braces included."""
+    for match in re.finditer(r"\b" + re.escape(func) + r"\s*\([^;{]*\)\s*\{", text):
+        # walk back to the start of the line holding the return type
+        start = text.rfind("\n", 0, match.start()) + 1
+        depth = 0
+        for i in range(match.end() - 1, len(text)):
+            if text[i] == "{":
+                depth += 1
+            elif text[i] == "}":
+                depth -= 1
+                if depth == 0:
+                    return start, i + 1
+    return None
+
+
+def preprocess(c_file, defines):
+    cmd = [CPP] + CPP_FLAGS + [f"-D{d}" for d in defines] + [c_file]
+    return subprocess.run(cmd, check=True, stdout=subprocess.PIPE, text=True).stdout
+
+
+# Mutations, all on the text of the function only
+
+re_simple_stmt = re.compile(r"^(\s*)(?!return\b|break\b|continue\b|goto\b|case\b|default\b|if\b|else\b|for\b|while\b|do\b|switch\b)[^{};]*;\s*$")
+re_decl = re.compile(r"^(\s*)(register\s+)?((?:unsigned\s+|signed\s+|const\s+|volatile\s+)*\w+[\s*]+)(\w+)(\s*(?:=[^;]*)?;)\s*$")
+re_incdec = re.compile(r"^(\s*)([\w.\->\[\]]+)\s*(\+\+|--|\+= 1|-= 1)\s*;\s*$")
+# operators need spaces around them so that "a->b" is never split
+re_compare = re.compile(r"([\w.\->\[\]]+)\s+(<=|>=|<|>|==|!=)\s+([\w.\->\[\]]+)")
+re_commutative = re.compile(r"([\w.\->\[\]]+)\s+([+&|^*])\s+([\w.\->\[\]]+)")
+
+FLIPPED = {"<": ">", ">": "<", "<=": ">=", ">=": "<=", "==": "==", "!=": "!="}
+TYPES = ("char", "short", "int", "long", "s8", "u8", "s16", "u16", "s32", "u32", "unsigned", "signed")
+
+
+def mutate_swap_statements(lines, rng):
+    candidates = [i for i in range(len(lines) - 1)
+                  if re_simple_stmt.match(lines[i]) and re_simple_stmt.match(lines[i + 1])
+                  and re_simple_stmt.match(lines[i]).group(1) == re_simple_stmt.match(lines[i + 1]).group(1)]
+    if not candidates:
+        return False
+    i = rng.choice(candidates)
+    lines[i], lines[i + 1] = lines[i + 1], lines[i]
+    return True
+
+
+def is_decl(line):
+    match = re_decl.match(line)
+    if match is None:
+        return False
+    type_name = match.group(3).split()[0]
+    return type_name in TYPES or type_name.isupper() or type_name.startswith("_")
+
+
+def mutate_swap_declarations(lines, rng):
+    candidates = [i for i in range(len(lines) - 1) if is_decl(lines[i]) and is_decl(lines[i + 1])
+                  and "=" not in lines[i] and "=" not in lines[i + 1]]
+    if not candidates:
+        return False
+    i = rng.choice(candidates)
+    lines[i], lines[i + 1] = lines[i + 1], lines[i]
+    return True
+
+
+def mutate_register(lines, rng):
+    candidates = [i for i, line in enumerate(lines) if is_decl(line)]
+    if not candidates:
+        return False
+    i = rng.choice(candidates)
+    match = re_decl.match(lines[i])
+    if match.group(2):
+        lines[i] = match.group(1) + lines[i][match.end(2):]
+    else:
+        lines[i] = match.group(1) + "register " + lines[i][match.end(1):]
+    return True
+
+
+def mutate_incdec(lines, rng):
+    candidates = [i for i, line in enumerate(lines) if re_incdec.match(line)]
+    if not candidates:
+        return False
+    i = rng.choice(candidates)
+    indent, lvalue, op = re_incdec.match(lines[i]).groups()
+    plus = op in ("++", "+= 1")
+    forms = [f"{lvalue}++;", f"++{lvalue};", f"{lvalue} += 1;"] if plus else \
+            [f"{lvalue}--;", f"--{lvalue};", f"{lvalue} -= 1;"]
+    lines[i] = indent + rng.choice(forms) + "\n"
+    return True
+
+
+def mutate_regex(lines, rng, regex, replace):
+    candidates = [(i, m) for i, line in enumerate(lines) for m in regex.finditer(line)
+                  if not line.lstrip().startswith("#")]
+    if not candidates:
+        return False
+    i, match = rng.choice(candidates)
+    lines[i] = lines[i][:match.start()] + replace(match) + lines[i][match.end():]
+    return True
+
+
+def mutate_flip_compare(lines, rng):
+    return mutate_regex(lines, rng, re_compare,
+                        lambda m: f"{m.group(3)} {FLIPPED[m.group(2)]} {m.group(1)}")
+
+
+def mutate_commutative(lines, rng):
+    return mutate_regex(lines, rng, re_commutative,
+                        lambda m: f"{m.group(3)} {m.group(2)} {m.group(1)}")
+
+
+MUTATIONS = [
+    (mutate_swap_statements, 5),
+    (mutate_swap_declarations, 3),
+    (mutate_register, 2),
+    (mutate_incdec, 2),
+    (mutate_flip_compare, 2),
+    (mutate_commutative, 2),
+]
+
+
+def mutate(func_text, rng):
+    lines = func_text.splitlines(keepends=True)
+    funcs, weights = zip(*MUTATIONS)
+    for _ in range(rng.choice((1, 1, 1, 2, 3))):
+        for _ in range(8):
+            if rng.choices(funcs, weights)[0](lines, rng):
+                break
+    return "".join(lines)
+
+
+# ELF object reading, enough to pull one function and its relocations out of an unlinked .o
+
+def read_function_from_object(data, func):
+    if data[:4] != b"\x7fELF":
+        return None, ()
+    shoff, = struct.unpack_from("<I", data, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from("<HHH", data, 0x2E)
+    sections = []
+    for i in range(shnum):
+        name, typ, flags, addr, offset, size, link, info, align, entsize = struct.unpack_from(
+            "<IIIIIIIIII", data, shoff + i * shentsize)
+        sections.append((name, typ, offset, size, link, info, entsize))
+    shstr = sections[shstrndx]
+
+    def section_name(s):
+        start = shstr[2] + s[0]
+        return data[start:data.index(b"\0", start)].decode()
+
+    symtab_index = next((i for i, s in enumerate(sections) if s[1] == 2), None)
+    if symtab_index is None:
+        return None, ()
+    symtab = sections[symtab_index]
+    strtab = sections[symtab[4]]
+    symbols = []
+    for off in range(symtab[2], symtab[2] + symtab[3], 16):
+        name, value, size, info, other, shndx = struct.unpack_from("<IIIBBH", data, off)
+        start = strtab[2] + name
+        symbols.append((data[start:data.index(b"\0", start)].decode(), value, size, shndx))
+    target = next((s for s in symbols if s[0] == func), None)
+    if target is None:
+        return None, ()
+    _, value, size, shndx = target
+    text = sections[shndx]
+    if size == 0:
+        # gcc 2.x doesn't emit .size for mips, use the next symbol in the section
+        following = sorted(v for n, v, _, x in symbols if x == shndx and v > value)
+        size = (following[0] if following else text[3]) - value
+    code = data[text[2] + value:text[2] + value + size]
+    relocs = set()
+    for s in sections:
+        if s[1] == 9 and s[5] == shndx:  # SHT_REL applying to our section
+            for off in range(s[2], s[2] + s[3], 8):
+                r_offset, = struct.unpack_from("<I", data, off)
+                if value <= r_offset < value + size:
+                    relocs.add((r_offset - value) // 4)
+    return code, relocs
+
+
+# Workers
+
+class Compiler:
+    # cc1-27 and as are one-shot programs: they read one input and exit, there is no way to keep them
+    # running between candidates, so each candidate pays for starting both. maspsx and patchasm are
+    # Python and run in this process. `times` has the seconds spent in each stage, so the cost of the
+    # two process starts shows up in the summary.
+    STAGES = ("cc1", "maspsx", "as", "score")
+
+    def __init__(self, cc_flags, workdir):
+        self.cc_flags = cc_flags
+        self.obj = os.path.join(workdir, "candidate.o")
+        self.times = dict.fromkeys(self.STAGES, 0.0)
+        sys.path.insert(0, "tools/maspx")
+        try:
+            import maspsx
+        except ImportError:
+            sys.exit("tools/maspx is missing, run git submodule update --init tools/maspx")
+        self.maspsx_main = maspsx.main
+        import patchasm
+        self.patch_asm = patchasm.patch_asm
+
+    def run_maspsx(self, asm):
+        # through maspsx's own command line handling, so the options mean what they mean in the Makefile
+        argv, stdin = sys.argv, sys.stdin
+        out = io.StringIO()
+        sys.argv, sys.stdin = MASPSX[1:], io.StringIO(asm)
+        try:
+            with contextlib.redirect_stdout(out):
+                self.maspsx_main()
+        finally:
+            sys.argv, sys.stdin = argv, stdin
+        return out.getvalue()
+
+    def compile(self, source):
+        t = time.perf_counter()
+        cc = subprocess.run([CC] + self.cc_flags, input=source, stdout=subprocess.PIPE,
+                            stderr=subprocess.DEVNULL, text=True)
+        self.times["cc1"] += time.perf_counter() - t
+        if cc.returncode != 0:
+            return None
+        t = time.perf_counter()
+        asm = self.patch_asm(self.run_maspsx(cc.stdout))
+        self.times["maspsx"] += time.perf_counter() - t
+        t = time.perf_counter()
+        result = subprocess.run([AS] + AS_FLAGS + ["-o", self.obj], input=asm, stderr=subprocess.DEVNULL, text=True)
+        self.times["as"] += time.perf_counter() - t
+        if result.returncode != 0:
+            return None
+        with open(self.obj, "rb") as f:
+            return f.read()
+
+
+def evaluate(compiler, prefix, func_text, suffix, func, target):
+    obj = compiler.compile(prefix + func_text + suffix)
+    if obj is None:
+        return None
+    t = time.perf_counter()
+    code, relocs = read_function_from_object(obj, func)
+    score = None if code is None else mips.score(mips.decode_bytes(code), target, relocs)
+    compiler.times["score"] += time.perf_counter() - t
+    return score
+
+
+def worker(seed, prefix, func_text, suffix, func, target, cc_flags, deadline, results):
+    rng = random.Random(seed)
+    with tempfile.TemporaryDirectory(prefix="permuter") as workdir:
+        compiler = Compiler(cc_flags, workdir)
+        best_text = func_text
+        best = evaluate(compiler, prefix, func_text, suffix, func, target)
+        iterations = 0
+        while time.time() < deadline and best != 0:
+            # mostly climb from our current best, sometimes restart from the original
+            base = func_text if rng.random() < 0.05 else best_text
+            candidate = mutate(base, rng)
+            iterations += 1
+            if candidate == base:
+                continue
+            score = evaluate(compiler, prefix, candidate, suffix, func, target)
+            if score is None or best is None or score > best:
+                continue
+            if score < best:
+                results.put((score, candidate, iterations, None))
+                iterations = 0
+            best, best_text = score, candidate
+        results.put((None, None, iterations, compiler.times))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Search source permutations of a function for a match")
+    parser.add_argument("c_file", help="C file holding the function, e.g. src/rock_neo/game.c")
+    parser.add_argument("function", help="function to permute")
+    parser.add_argument("-j", dest="jobs", type=int, default=multiprocessing.cpu_count(), help="worker count")
+    parser.add_argument("--time", type=int, default=600, help="seconds to search for")
+    parser.add_argument("-D", dest="defines", action="append", default=["ACCEPT_REORDERING_BULLSHIT"],
+                        help="extra preprocessor defines")
+    parser.add_argument("--seed", type=int, default=None)
+    args = parser.parse_args()
+
+    asm_file = find_target_asm(args.c_file, args.function)
+    if asm_file is None or not os.path.exists(asm_file):
+        sys.exit(f"no INCLUDE_ASM target found for {args.function} in {args.c_file}")
+    target = read_target(asm_file)
+
+    source = preprocess(args.c_file, args.defines)
+    span = find_function(source, args.function)
+    if span is None:
+        sys.exit(f"{args.function} has no C definition with {' '.join('-D' + d for d in args.defines)}")
+    prefix, func_text, suffix = source[:span[0]], source[span[0]:span[1]], source[span[1]:]
+
+    module = modules.module_for_path(args.c_file)
+    cc_flags = CC_FLAGS_ROCK_NEO if module is None or module.is_rock_neo else CC_FLAGS_OVERLAY
+
+    with tempfile.TemporaryDirectory(prefix="permuter") as workdir:
+        base = evaluate(Compiler(cc_flags, workdir), prefix, func_text, suffix, args.function, target)
+    if base is None:
+        sys.exit("the unmodified function doesn't compile")
+    print(f"{args.function}: {len(target)} target instructions, base score {base}, {args.jobs} workers")
+    if base == 0:
+        print("already matching")
+        return
+
+    out_dir = os.path.join(OUTPUT_DIR, args.function)
+    os.makedirs(out_dir, exist_ok=True)
+    seed = args.seed if args.seed is not None else random.randrange(1 << 30)
+    deadline = time.time() + args.time
+    results = multiprocessing.Queue()
+    procs = [multiprocessing.Process(target=worker, daemon=True,
+                                     args=(seed + i, prefix, func_text, suffix, args.function, target,
+                                           cc_flags, deadline, results))
+             for i in range(args.jobs)]
+    for p in procs:
+        p.start()
+
+    best = base
+    stage_times = dict.fromkeys(Compiler.STAGES, 0.0)
+    done = 0
+    total = 0
+    outputs = 0
+    start = time.time()
+    try:
+        while done < len(procs):
+            try:
+                score, text, iterations, times = results.get(timeout=1)
+            except queue.Empty:
+                continue
+            total += iterations
+            if score is None:
+                done += 1
+                for stage in Compiler.STAGES:
+                    stage_times[stage] += times[stage]
+                continue
+            if score < best:
+                best = score
+                outputs += 1
+                path = os.path.join(out_dir, f"output-{score}-{outputs}.c")
+                with open(path, "w") as f:
+                    f.write(text)
+                rate = total / max(time.time() - start, 1e-3)
+                print(f"[{time.time() - start:7.1f}s] new best {score} ({rate:.0f} candidates/s) -> {path}")
+                if score == 0:
+                    print("found a match!")
+                    break
+    except KeyboardInterrupt:
+        pass
+    for p in procs:
+        p.terminate()
+    print(f"{total} candidates tried, best score {best} (base {base})")
+    if done == len(procs) and total:
+        # only complete when every worker reported, i.e. not after a match or ^C
+        per = ", ".join(f"{stage} {stage_times[stage] / total * 1000:.1f}" for stage in Compiler.STAGES)
+        print(f"ms per candidate and worker: {per}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,139 @@
+# Parsing of the asm splat writes to asm/, shared by the analysis tools
+#
+# Functions come from `glabel` blocks whose instructions carry the rom offset, vram and raw word in a
+# comment:
+#     glabel func_80016DAC
+#         /* 75AC 80016DAC 3C021F80 */  lui        $v0, (0x1F800070 >> 16)
+# Data files give us the function pointer tables:
+#     glabel Game_main_tbl
+#         /* 7D1D4 800829D4 */ .word func_80015634
+#
+# Chunks that splat only dumps as data (most PROGBIN overlays for now) have no functions in asm/, for
+# those carve_functions() cuts the retail code into functions on prologues and `jr $ra`.
+
+import os
+import re
+
+import mips
+import modules
+
+re_glabel = re.compile(r"^\s*glabel\s+(\w+)")
+re_label = re.compile(r"^\s*(\w+):\s*$")
+re_endlabel = re.compile(r"^\s*(?:endlabel|\.size)\s+(\w+)")
+re_ins = re.compile(r"/\*\s*[0-9A-Fa-f]+\s+([0-9A-Fa-f]{8})\s+([0-9A-Fa-f]{8})\s*\*/")
+re_data_word = re.compile(r"/\*\s*[0-9A-Fa-f]+\s+([0-9A-Fa-f]{8})\s*\*/\s*\.word\s+([\w.$]+)")
+
+
+class AsmFunction:
+    __slots__ = ("name", "vram", "words", "path", "module")
+
+    def __init__(self, name, vram, path, module):
+        self.name = name
+        self.vram = vram
+        self.words = []
+        self.path = path
+        self.module = module
+
+    def instructions(self):
+        return [mips.decode(w, self.vram + i * 4) for i, w in enumerate(self.words)]
+
+    def __repr__(self):
+        return f"{self.module}:{self.name}"
+
+
+def iter_asm_files(module):
+    root = module.asm_dir()
+    if not os.path.isdir(root):
+        return
+    for dirpath, _, files in os.walk(root):
+        for file in sorted(files):
+            if file.endswith(".s"):
+                yield os.path.join(dirpath, file)
+
+
+def parse_functions(path, module_name):
+    functions = []
+    current = None
+    with open(path, "r", errors="replace") as f:
+        for line in f:
+            match = re_glabel.match(line)
+            if match:
+                current = AsmFunction(match.group(1), None, path, module_name)
+                functions.append(current)
+                continue
+            if current is None:
+                continue
+            if re_endlabel.match(line):
+                current = None
+                continue
+            match = re_ins.search(line)
+            if match and ".word" not in line:
+                if current.vram is None:
+                    current.vram = int(match.group(1), 16)
+                current.words.append(int(match.group(2), 16))
+    # a glabel with no instructions is a data label
+    return [fn for fn in functions if fn.words]
+
+
+def parse_data_words(path):
+    """Yields (label, vram, symbol) for every `.word <symbol>` in a data file."""
+    label = None
+    with open(path, "r", errors="replace") as f:
+        for line in f:
+            match = re_glabel.match(line)
+            if match:
+                label = match.group(1)
+                continue
+            match = re_data_word.search(line)
+            if match:
+                yield label, int(match.group(1), 16), match.group(2)
+
+
+def module_functions(module):
+    functions = {}
+    for path in iter_asm_files(module):
+        if os.sep + "data" + os.sep in path:
+            continue
+        for fn in parse_functions(path, module.name):
+            # nonmatchings/*.s and the asm segment may both hold a function, keep the first one
+            functions.setdefault(fn.vram, fn)
+    if not functions and "progbin" in (module.chunk or "").lower():
+        for fn in carve_functions(module):
+            functions[fn.vram] = fn
+    return sorted(functions.values(), key=lambda fn: fn.vram)
+
+
+def carve_functions(module):
+    """Cuts the retail code of a data-only chunk into functions on `addiu $sp` prologues and `jr $ra`."""
+    path = module.original_image_path()
+    if not os.path.exists(path) or module.size is None:
+        return []
+    data = modules.read_range(path, module.original_offset(module.vram), module.size)
+    words = mips.words_from_bytes(data)
+    functions = []
+    current = None
+    i = 0
+    while i < len(words):
+        word = words[i]
+        ins = mips.decode(word)
+        if current is None:
+            # skip padding and anything that doesn't decode as code
+            if word == 0 or ins.mnemonic == "unknown":
+                i += 1
+                continue
+            vram = module.vram + i * 4
+            current = AsmFunction(f"func_{vram:08X}", vram, path, module.name)
+        if ins.mnemonic == "unknown":
+            current = None
+            i += 1
+            continue
+        current.words.append(word)
+        if ins.mnemonic == "jr" and ins.rs == 31:
+            if i + 1 < len(words):
+                current.words.append(words[i + 1])
+            functions.append(current)
+            current = None
+            i += 2
+            continue
+        i += 1
+    return functions
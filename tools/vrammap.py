@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+
+# Checks the VRAM of the runtime features (VRAM_RESERVE_* in include/rock_neo/gpu.h) against the
+# textures of the disc
+#
+# The screen cache of FEATURES=GPU_SCREEN_CACHE and the glyph atlas of FEATURES=MOJI_GLYPH_CACHE are
+# in a part of VRAM the retail code must never upload to. Every texture chunk of the CDDATA/DAT archives (types 1, 9 and 10) carries the rect it
+# is uploaded to at 0x1C: x, y, w, h as u32, w and h being what tools/chunk2splatyaml.py sizes the
+# chunk by. This lists the ones that overlap the reservation and fails if there are any. Uploads that
+# don't come from an archive chunk aren't seen here, the LoadImage and MoveImage hooks of
+# src/rock_neo/feature/vram.c count those at run time (Vram_reserve_conflicts).
+#
+# Usage: python3 tools/vrammap.py disks/mml1.us.track1.bin [--all]
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+sys.path.append(os.path.dirname(os.path.realpath(__file__)))
+import cdpos
+
+GPU_H = "include/rock_neo/gpu.h"
+TEXTURE_TYPES = (1, 9, 10)
+TEXTURE_RECT = 0x1C
+CHUNK_HEADER_ONLY = 4  # the payload follows the header within its sector, see tools/chunk2splatyaml.py
+
+
+def read_reservation():
+    """Returns (x, y, w, h) of the VRAM_RESERVE_ defines."""
+    with open(GPU_H, "r") as f:
+        text = f.read()
+    return tuple(int(re.search(rf"#define VRAM_RESERVE_{c}\s+(\w+)", text).group(1), 0) for c in "XYWH")
+
+
+def texture_rects(data):
+    """Returns [(offset, name, (x, y, w, h))] of the texture chunks, and where the walk stopped."""
+    rects = []
+    offset = 0
+    while offset + cdpos.SECTOR_SIZE <= len(data):
+        chunk_type, size = struct.unpack_from("<II", data, offset)
+        if chunk_type == cdpos.CHUNK_END:
+            return rects, None
+        name = data[offset + 0x40:offset + 0x60].split(b"\0")[0].decode("ascii", errors="replace")
+        if chunk_type in TEXTURE_TYPES:
+            rect = struct.unpack_from("<IIII", data, offset + TEXTURE_RECT)
+            rects.append((offset, name, rect))
+            size = rect[2] * rect[3] * 2
+        if offset + cdpos.SECTOR_SIZE + size > len(data):
+            return rects, offset
+        if chunk_type == CHUNK_HEADER_ONLY:
+            offset += (size + cdpos.SECTOR_SIZE - 1) & ~(cdpos.SECTOR_SIZE - 1)
+        else:
+            offset += cdpos.SECTOR_SIZE + ((size + cdpos.SECTOR_SIZE - 1) & ~(cdpos.SECTOR_SIZE - 1))
+    return rects, None
+
+
+def overlaps(a, b):
+    return a[0] < b[0] + b[2] and b[0] < a[0] + a[2] and a[1] < b[1] + b[3] and b[1] < a[1] + a[3]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Check the VRAM reservation of the features against the disc")
+    parser.add_argument("image")
+    parser.add_argument("--all", action="store_true", help="list every texture rect")
+    args = parser.parse_args()
+
+    reserve = read_reservation()
+    image = cdpos.DiscImage(args.image)
+    textures = 0
+    conflicts = 0
+    unwalked = 0
+    for entry in image.list_dir(image.find("CDDATA/DAT")):
+        rects, stopped = texture_rects(image.read_extent(entry[1], entry[2]))
+        if stopped is not None:
+            print(f"{entry[0]}: chunks not followed past 0x{stopped:X}, the rest isn't checked")
+            unwalked += 1
+        for offset, name, rect in rects:
+            textures += 1
+            hit = overlaps(rect, reserve)
+            conflicts += hit
+            if hit or args.all:
+                print(f"{entry[0]}: 0x{offset:06X} {name} {rect[2]}x{rect[3]} at {rect[0]},{rect[1]}"
+                      f"{'  in the reservation' if hit else ''}")
+    print(f"{textures} textures, {conflicts} in {reserve[2]}x{reserve[3]} at {reserve[0]},{reserve[1]}, "
+          f"{unwalked} files not fully checked")
+    if conflicts:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,454 @@
+#!/usr/bin/env python3
+
+# Watch daemon: rebuilds only what an edit touches and reports per-function match status
+#
+# `make` re-evaluates the whole Makefile and `make check` re-hashes every archive, which is far too
+# slow for the edit -> verdict loop. This keeps a dependency map of src/, include/ and asm/ in memory:
+#   - every .c file depends on the headers it #includes (recursively) and on the .s files pulled in by
+#     INCLUDE_ASM("dir", name)
+#   - every .s file under asm/ that is assembled on its own is its own object
+# On each save only the affected objects are rebuilt, only their owning module (rock_neo or a single
+# archive chunk) is relinked, and the functions of the rebuilt objects are compared against the retail
+# image.
+#
+# The rock_neo commands are the ones `make toolchain` prints, so FEATURES, BUILD_DIR and the feature
+# flags are the same as in a full build: src/rock_neo/feature is only built with FEATURES, linked by
+# config/feature.ld and checked by tools/featurelink.py, and it has nothing to match. Overlay chunks are compiled with the flags of
+# tools/buildoverlay.py. When a rock_neo relink moves a symbol, the overlays are linked again against
+# the regenerated build/generated.rock_neo.syms.txt.
+#
+# Each rebuild prints its time, split into compile, link and verify. --bench N touches a file N times
+# and reports the median and worst times, to check the edit -> verdict loop stays under a second.
+#
+# Usage: python3 tools/watch.py [--module rock_neo] [--poll] [--features "..."] [--bench N FILE]
+
+import argparse
+import ctypes
+import ctypes.util
+import os
+import re
+import select
+import shutil
+import statistics
+import struct
+import subprocess
+import sys
+import time
+
+sys.path.append(os.path.dirname(os.path.realpath(__file__)))
+import buildoverlay
+import generate_rock_neo_syms
+import modules
+
+# filled by read_toolchain(): the commands and flags of the Makefile, as `make` expands them
+TOOLCHAIN = {}
+
+INCLUDE_DIRS = ["include"]
+WATCH_DIRS = [modules.SRC_DIR, "include", modules.ASM_DIR]
+WATCH_EXTS = (".c", ".h", ".s", ".inc")
+FEATURE_DIR = os.path.join(modules.SRC_DIR, modules.ROCK_NEO, "feature")
+DEBOUNCE = 0.05
+
+re_include = re.compile(r'^\s*#\s*include\s+"([^"]+)"', re.MULTILINE)
+re_include_asm = re.compile(r'INCLUDE_ASM\(\s*"([^"]+)"\s*,\s*(\w+)\s*\)')
+
+
+class DependencyMap:
+    def __init__(self):
+        self.deps = {}  # c file -> set of headers/.s files it depends on
+        self.users = {}  # header/.s file -> set of c files
+
+    def resolve_include(self, name, from_dir):
+        for d in [from_dir] + INCLUDE_DIRS:
+            path = os.path.normpath(os.path.join(d, name))
+            if os.path.exists(path):
+                return path
+        return None
+
+    def scan_file(self, path, seen):
+        try:
+            with open(path, "r", errors="replace") as f:
+                text = f.read()
+        except OSError:
+            return
+        for name in re_include.findall(text):
+            header = self.resolve_include(name, os.path.dirname(path))
+            if header is None or header in seen:
+                continue
+            seen.add(header)
+            self.scan_file(header, seen)
+        for folder, func in re_include_asm.findall(text):
+            seen.add(os.path.normpath(os.path.join(folder, f"{func}.s")))
+
+    def update(self, c_file):
+        for dep in self.deps.pop(c_file, ()):
+            self.users.get(dep, set()).discard(c_file)
+        if not os.path.exists(c_file):
+            return
+        seen = set()
+        self.scan_file(c_file, seen)
+        self.deps[c_file] = seen
+        for dep in seen:
+            self.users.setdefault(dep, set()).add(c_file)
+
+    def build(self, src_dir):
+        for root, _, files in os.walk(src_dir):
+            for file in files:
+                if file.endswith(".c"):
+                    self.update(os.path.join(root, file))
+
+    def affected(self, path):
+        """Returns the source files whose object has to be rebuilt after `path` changed."""
+        path = os.path.normpath(path)
+        if path.endswith(".c"):
+            self.update(path)
+            return {path}
+        if path.endswith(".h"):
+            # the header's own includes may have changed: rescan its users
+            users = set(self.users.get(path, ()))
+            for c_file in users:
+                self.update(c_file)
+            return users
+        users = set(self.users.get(path, ()))
+        if path.endswith(".s") and not users and is_standalone_asm(path):
+            return {path}
+        return users
+
+
+def is_standalone_asm(path):
+    # asm/<module>/*.s and asm/<module>/data/*.s are assembled directly, nonmatchings/ is included
+    return os.sep + "nonmatchings" + os.sep not in path
+
+
+def is_feature_source(src):
+    return os.path.normpath(src).startswith(FEATURE_DIR + os.sep)
+
+
+def object_path(src):
+    return os.path.join(modules.BUILD_DIR, src + ".o")
+
+
+def run(cmd):
+    result = subprocess.run(cmd, shell=True, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    return result.returncode, result.stdout
+
+
+def read_toolchain(features):
+    # the Makefile is the only place the toolchain is spelled out: ask it, with the same FEATURES
+    cmd = ["make", "-s", "--no-print-directory", "toolchain", f"FEATURES={features}"]
+    result = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    if result.returncode != 0:
+        sys.exit(f"make toolchain failed:\n{result.stdout}")
+    for line in result.stdout.splitlines():
+        key, sep, value = line.partition("=")
+        if sep:
+            TOOLCHAIN[key] = value.strip()
+    modules.BUILD_DIR = TOOLCHAIN["BUILD_DIR"]
+    generate_rock_neo_syms.BUILD_DIR = TOOLCHAIN["BUILD_DIR"]
+
+
+def compile_source(src, module):
+    t = TOOLCHAIN
+    obj = object_path(src)
+    os.makedirs(os.path.dirname(obj), exist_ok=True)
+    if src.endswith(".s"):
+        return run(f"{t['AS']} {t['AS_FLAGS']} -o {obj} {src}")
+    if is_feature_source(src):
+        cpp_flags, cc_flags = t["FEATURE_CPP_FLAGS"], t["FEATURE_CC_FLAGS"]
+    elif module.is_rock_neo:
+        cpp_flags, cc_flags = t["CPP_FLAGS"], t["CC_FLAGS"]
+    else:
+        # the overlays don't take FEATURES, see tools/buildoverlay.py
+        cpp_flags, cc_flags = buildoverlay.CPP_FLAGS, buildoverlay.CC_FLAGS
+    return run(f"{t['CPP']} {cpp_flags} {src} | {t['CC']} {cc_flags} | {t['MASPSX']} | "
+               f"{t['PYTHON']} {t['PYPATCHASM']} | {t['AS']} {t['AS_FLAGS']} -o {obj}")
+
+
+def link_module(module):
+    t = TOOLCHAIN
+    v = modules.VERSION
+    if module.is_rock_neo:
+        elf = module.elf_path()
+        # the features go first, before the /DISCARD/ of rock_neo.ld
+        scripts = (f"{t['FEATURE_LD_FLAGS']} -T rock_neo.ld -T config/undefined_syms_auto.{v}.rock_neo.txt "
+                   f"-T config/undefined_funcs_auto.{v}.rock_neo.txt")
+        flags = "--no-check-sections -nostdlib"
+        code, out = run(f"{t['LD']} -o {elf}.unstripped -Map {module.map_path()} {scripts} {flags} -g")
+        if code == 0:
+            code, out = run(f"{t['LD']} -o {elf} -Map {module.map_path()} {scripts} {flags} -s")
+        if code == 0:
+            code, out = run(f"{t['OBJCOPY']} -O binary {elf} {module.built_image_path()}")
+        if code == 0 and t["FEATURE_LD_FLAGS"]:
+            code, out = run(f"{t['FEATURELINK']} {elf}.unstripped {module.built_image_path()}")
+        return code, out
+    archive, chunk = module.archive, module.chunk
+    elf = module.elf_path()
+    config = f"config/overlay/splat.{v}.{archive}"
+    code, out = run(f"{t['LD']} -o {elf} -Map {module.map_path()} -T ./{archive}.{chunk}.ld "
+                    f"-T {config}/undefined_syms_auto.{v}.{chunk}.txt "
+                    f"-T {config}/undefined_funcs_auto.{v}.{chunk}.txt "
+                    f"-T {modules.BUILD_DIR}/generated.rock_neo.syms.txt --no-check-sections -nostdlib -s")
+    if code == 0:
+        code, out = run(f"{t['OBJCOPY']} -O binary {elf} {module.built_image_path()}")
+    if code == 0:
+        splice_chunk(module)
+    return code, out
+
+
+def refresh_rock_neo_syms():
+    """Regenerates the rock_neo symbols the overlays link against, returns True when they changed."""
+    path = os.path.join(modules.BUILD_DIR, "generated.rock_neo.syms.txt")
+    before = open(path).read() if os.path.exists(path) else None
+    generate_rock_neo_syms.generate_rock_neo_syms_txt()
+    with open(path) as f:
+        return f.read() != before
+
+
+def relink_overlays(only):
+    # a rock_neo symbol moved: every overlay that was built links against the old address
+    relinked = 0
+    for module in modules.all_modules():
+        if module.is_rock_neo or (only and module.name != only):
+            continue
+        if not os.path.exists(module.elf_path()):
+            continue
+        code, out = link_module(module)
+        if code != 0:
+            print(f"  ! link {module.name}\n{out}")
+        relinked += 1
+    print(f"  rock_neo symbols moved, {relinked} overlay chunks relinked")
+
+
+def splice_chunk(module):
+    # same as tools/buildoverlay.py: emplace the rebuilt chunk into a copy of the retail archive
+    archive_path = os.path.join(modules.BUILD_DIR, f"{module.archive}.BIN")
+    if not os.path.exists(archive_path):
+        shutil.copyfile(module.original_image_path(), archive_path)
+    with open(module.built_image_path(), "rb") as chunk:
+        data = chunk.read()
+    with open(archive_path, "r+b") as f:
+        f.seek(module.offset)
+        f.write(data)
+
+
+class OriginalCache:
+    # the retail images never change while we run, keep them in memory
+    def __init__(self):
+        self.images = {}
+
+    def read(self, path, offset, size):
+        if path not in self.images:
+            with open(path, "rb") as f:
+                self.images[path] = f.read()
+        return self.images[path][offset:offset + size]
+
+
+def report(module, objs, originals, previous):
+    if not os.path.exists(module.map_path()):
+        print(f"  {module.name}: no map file, can't verify")
+        return
+    with open(module.built_image_path(), "rb") as f:
+        built = f.read()
+    matched = 0
+    syms = modules.text_symbols(module.map_path(), objs)
+    for sym in syms:
+        mine = built[module.built_offset(sym.vram):module.built_offset(sym.vram) + sym.size]
+        good = originals.read(module.original_image_path(), module.original_offset(sym.vram), sym.size)
+        diff = sum(1 for i in range(0, min(len(mine), len(good)), 4) if mine[i:i + 4] != good[i:i + 4])
+        diff += abs(len(good) - len(mine)) // 4
+        status = "OK" if diff == 0 else f"{diff}/{sym.size // 4} words differ"
+        changed = previous.get(sym.name) != diff
+        previous[sym.name] = diff
+        if diff == 0:
+            matched += 1
+        if changed or diff != 0:
+            print(f"  {'+' if diff == 0 else '-'} {sym.name:<40} {status}")
+    print(f"  {module.name}: {matched}/{len(syms)} functions match")
+
+
+class Inotify:
+    IN_MODIFY = 0x2
+    IN_CLOSE_WRITE = 0x8
+    IN_MOVED_TO = 0x80
+    IN_CREATE = 0x100
+    IN_DELETE = 0x200
+    IN_ISDIR = 0x40000000
+
+    def __init__(self):
+        libc = ctypes.CDLL(ctypes.util.find_library("c"), use_errno=True)
+        self.libc = libc
+        self.fd = libc.inotify_init1(os.O_NONBLOCK | os.O_CLOEXEC)
+        if self.fd < 0:
+            raise OSError(ctypes.get_errno(), "inotify_init1")
+        self.wds = {}
+
+    def add_tree(self, root):
+        mask = self.IN_CLOSE_WRITE | self.IN_MOVED_TO | self.IN_CREATE | self.IN_DELETE
+        for dirpath, _, _ in os.walk(root):
+            wd = self.libc.inotify_add_watch(self.fd, dirpath.encode(), mask)
+            if wd >= 0:
+                self.wds[wd] = dirpath
+
+    def read(self, timeout):
+        ready, _, _ = select.select([self.fd], [], [], timeout)
+        if not ready:
+            return []
+        data = os.read(self.fd, 64 * 1024)
+        events = []
+        i = 0
+        while i < len(data):
+            wd, mask, _, length = struct.unpack_from("iIII", data, i)
+            name = data[i + 16:i + 16 + length].split(b"\0")[0].decode()
+            i += 16 + length
+            path = os.path.join(self.wds.get(wd, ""), name)
+            if mask & self.IN_ISDIR:
+                if mask & (self.IN_CREATE | self.IN_MOVED_TO):
+                    self.add_tree(path)
+                continue
+            events.append(path)
+        return events
+
+
+class Poller:
+    # fallback for systems without inotify
+    def __init__(self):
+        self.mtimes = {}
+        self.roots = []
+
+    def add_tree(self, root):
+        self.roots.append(root)
+        self.scan()
+
+    def scan(self):
+        changed = []
+        for root in self.roots:
+            for dirpath, _, files in os.walk(root):
+                for file in files:
+                    path = os.path.join(dirpath, file)
+                    try:
+                        mtime = os.stat(path).st_mtime_ns
+                    except OSError:
+                        continue
+                    if self.mtimes.get(path) != mtime:
+                        if path in self.mtimes:
+                            changed.append(path)
+                        self.mtimes[path] = mtime
+        return changed
+
+    def read(self, timeout):
+        time.sleep(timeout)
+        return self.scan()
+
+
+def collect(watcher):
+    # editors usually write in several steps (truncate, write, rename): wait until it settles
+    events = set(watcher.read(None if isinstance(watcher, Inotify) else 0.25))
+    while True:
+        more = watcher.read(DEBOUNCE)
+        if not more:
+            break
+        events.update(more)
+    return sorted(p for p in events if p.endswith(WATCH_EXTS) and os.path.exists(p))
+
+
+def rebuild(paths, depmap, originals, previous, only):
+    """Returns the time spent in each stage, or None when nothing had to be rebuilt."""
+    times = {"cc": 0.0, "ld": 0.0, "verify": 0.0, "failed": False}
+    start = time.perf_counter()
+    sources = set()
+    for path in paths:
+        sources |= depmap.affected(path)
+    by_module = {}
+    for src in sorted(sources):
+        module = modules.module_for_path(src)
+        if module is None or (only and module.name != only):
+            continue
+        if is_feature_source(src) and not TOOLCHAIN["FEATURE_LD_FLAGS"]:
+            continue
+        by_module.setdefault(module.name, (module, []))[1].append(src)
+    if not by_module:
+        return None
+    for name, (module, srcs) in by_module.items():
+        failed = False
+        t = time.perf_counter()
+        for src in srcs:
+            code, out = compile_source(src, module)
+            if code != 0:
+                print(f"  ! {src}\n{out}")
+                failed = True
+        times["cc"] += time.perf_counter() - t
+        if failed:
+            times["failed"] = True
+            continue
+        t = time.perf_counter()
+        code, out = link_module(module)
+        if code == 0 and module.is_rock_neo and refresh_rock_neo_syms():
+            relink_overlays(only)
+        times["ld"] += time.perf_counter() - t
+        if code != 0:
+            print(f"  ! link {name}\n{out}")
+            times["failed"] = True
+            continue
+        t = time.perf_counter()
+        report(module, {object_path(src) for src in srcs if not is_feature_source(src)}, originals, previous)
+        times["verify"] += time.perf_counter() - t
+    times["total"] = time.perf_counter() - start
+    print(f"[{times['total']:.2f}s: cc {times['cc']:.2f} ld {times['ld']:.2f} verify {times['verify']:.2f}] "
+          f"{', '.join(os.path.relpath(p) for p in paths)}")
+    return times
+
+
+def bench(path, count, depmap, only):
+    # the edit -> verdict time of a save of `path`, without the watcher's debounce
+    originals = OriginalCache()
+    samples = []
+    for _ in range(count):
+        os.utime(path)
+        times = rebuild([path], depmap, originals, {}, only)
+        if times is None:
+            sys.exit(f"{path} isn't part of any module")
+        if times["failed"]:
+            sys.exit("the rebuild failed, no times to report")
+        samples.append(times)
+    for stage in ("cc", "ld", "verify", "total"):
+        values = sorted(sample[stage] for sample in samples)
+        print(f"{stage:>6}: median {statistics.median(values):.3f}s, worst {values[-1]:.3f}s")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Rebuild and verify only what an edit touches")
+    parser.add_argument("--module", default=None, help="only rebuild this module (rock_neo or ARCHIVE/chunk)")
+    parser.add_argument("--poll", action="store_true", help="poll mtimes instead of using inotify")
+    parser.add_argument("--features", default=os.environ.get("FEATURES", ""),
+                        help="FEATURES of the build to keep up to date (default: $FEATURES)")
+    parser.add_argument("--bench", nargs=2, metavar=("N", "FILE"),
+                        help="rebuild FILE N times and report the times instead of watching")
+    args = parser.parse_args()
+
+    read_toolchain(args.features)
+    depmap = DependencyMap()
+    depmap.build(modules.SRC_DIR)
+    print(f"Tracking {len(depmap.deps)} source files, {len(depmap.users)} dependencies")
+
+    if args.bench:
+        bench(args.bench[1], int(args.bench[0]), depmap, args.module)
+        return
+
+    watcher = Poller() if args.poll or not sys.platform.startswith("linux") else Inotify()
+    for d in WATCH_DIRS:
+        if os.path.isdir(d):
+            watcher.add_tree(d)
+
+    originals = OriginalCache()
+    previous = {}
+    try:
+        while True:
+            paths = collect(watcher)
+            if paths:
+                rebuild(paths, depmap, originals, previous, args.module)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()